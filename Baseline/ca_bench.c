@@ -0,0 +1,279 @@
+/*
+ * standalone (MPI-free) benchmark of the cellular automaton kernels
+ *
+ * every kernel of ca_kernels.c is run on a torus of varying width and
+ * height, sized to fit into L1, L2, L3 and main memory, with increasing
+ * numbers of OpenMP threads. Results are reported in GCUPS (giga cell
+ * updates per second) together with a STREAM-like bandwidth probe that
+ * bounds memory-bound kernels on a roofline: every cell update has to read
+ * and write at least one byte each.
+ *
+ * command line arguments (all optional):
+ * #1: minimum time per measurement in seconds (default: 0.1)
+ * #2: name of a single kernel to benchmark (default: all)
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ca_common.h"
+#include "ca_kernels.h"
+
+/* elements per array of the bandwidth probe (3 x 64 MiB) */
+#define STREAM_SIZE (8 * 1024 * 1024)
+#define STREAM_REPS 5
+
+/* minimum number of bytes read and written per cell update */
+#define BYTES_PER_CELL 2.0
+
+static const int widths[] = { 256, 1024, 4096 };
+
+/* approximate footprint of both configurations per memory level */
+static const struct {
+	const char *level;
+	size_t bytes;
+} levels[] = {
+	{ "L1", 24 * 1024 },
+	{ "L2", 512 * 1024 },
+	{ "L3", 8 * 1024 * 1024 },
+	{ "DRAM", 256 * 1024 * 1024 },
+};
+
+#define NUM_ELEMS(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static double now(void)
+{
+	TIME_GET(timer);
+	return timer.tv_sec + timer.tv_nsec / 1.0E+9;
+}
+
+static int max_threads(void)
+{
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+/* thread counts 1, 2, 4, ... and finally the maximum */
+static int next_threads(int num_threads, int thread_max)
+{
+	return num_threads < thread_max && num_threads * 2 > thread_max ?
+		thread_max : num_threads * 2;
+}
+
+static void set_threads(int num_threads)
+{
+#ifdef _OPENMP
+	omp_set_num_threads(num_threads);
+#else
+	(void)num_threads;
+#endif
+}
+
+/* best-of STREAM copy and triad bandwidth in GB/s */
+static void stream_probe(double *copy_gbs, double *triad_gbs)
+{
+	double *a = malloc(STREAM_SIZE * sizeof(*a));
+	double *b = malloc(STREAM_SIZE * sizeof(*b));
+	double *c = malloc(STREAM_SIZE * sizeof(*c));
+	const double scalar = 3.0;
+	double best_copy = 1.0E+30, best_triad = 1.0E+30;
+
+	#ifdef _OPENMP
+	#pragma omp parallel for
+	#endif
+	for (long i = 0; i < STREAM_SIZE; i++) {
+		a[i] = 1.0;
+		b[i] = 2.0;
+		c[i] = 0.0;
+	}
+
+	for (int r = 0; r < STREAM_REPS; r++) {
+		double t = now();
+		#ifdef _OPENMP
+		#pragma omp parallel for
+		#endif
+		for (long i = 0; i < STREAM_SIZE; i++) {
+			c[i] = a[i];
+		}
+		t = now() - t;
+		best_copy = t < best_copy ? t : best_copy;
+
+		t = now();
+		#ifdef _OPENMP
+		#pragma omp parallel for
+		#endif
+		for (long i = 0; i < STREAM_SIZE; i++) {
+			a[i] = b[i] + scalar * c[i];
+		}
+		t = now() - t;
+		best_triad = t < best_triad ? t : best_triad;
+	}
+
+	*copy_gbs = 2.0 * sizeof(double) * STREAM_SIZE / best_copy / 1.0E+9;
+	*triad_gbs = 3.0 * sizeof(double) * STREAM_SIZE / best_triad / 1.0E+9;
+
+	free(a);
+	free(b);
+	free(c);
+}
+
+/* torus-like boundary for a strided configuration */
+static void boundary(cell_state_t *buf, size_t stride, int width, int height)
+{
+	memcpy(buf, buf + height * stride, stride);
+	memcpy(buf + (height + 1) * stride, buf + stride, stride);
+	for (int y = 0; y <= height + 1; y++) {
+		buf[y * stride] = buf[y * stride + width];
+		buf[y * stride + width + 1] = buf[y * stride + 1];
+	}
+}
+
+/* random configuration (xorshift, the drivers' RNG is too slow for large sizes) */
+static void init_config(cell_state_t *buf, size_t stride, int width, int height)
+{
+	uint32_t state = 424243;
+
+	memset(buf, 0, (height + 2) * stride);
+	for (int y = 1; y <= height; y++) {
+		for (int x = 1; x <= width; x++) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			buf[y * stride + x] = state >> 31;
+		}
+	}
+}
+
+/* one iteration of kernel must match the reference kernel */
+static int verify(const struct ca_kernel *kernel, cell_state_t *from,
+		cell_state_t *to, cell_state_t *ref, size_t stride, int width, int height)
+{
+	init_config(from, stride, width, height);
+	boundary(from, stride, width, height);
+	memset(to, 0, (height + 2) * stride);
+	memset(ref, 0, (height + 2) * stride);
+
+	ca_kernel_run(&ca_kernels[0], from, ref, stride, width, 1, height);
+	ca_kernel_run_omp(kernel, from, to, stride, width, 1, height);
+
+	for (int y = 1; y <= height; y++) {
+		if (memcmp(to + y * stride + 1, ref + y * stride + 1, width) != 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* run iterations until min_time has passed, returns GCUPS */
+static double measure(const struct ca_kernel *kernel, cell_state_t *from,
+		cell_state_t *to, size_t stride, int width, int height, double min_time)
+{
+	long its = 0, chunk = 1;
+	double start, elapsed;
+
+	init_config(from, stride, width, height);
+
+	/* warm up caches and thread pool */
+	boundary(from, stride, width, height);
+	ca_kernel_run_omp(kernel, from, to, stride, width, 1, height);
+
+	start = now();
+	do {
+		for (long i = 0; i < chunk; i++) {
+			cell_state_t *temp;
+
+			boundary(from, stride, width, height);
+			ca_kernel_run_omp(kernel, from, to, stride, width, 1, height);
+
+			temp = from;
+			from = to;
+			to = temp;
+		}
+		its += chunk;
+		chunk *= 2;
+		elapsed = now() - start;
+	} while (elapsed < min_time);
+
+	return (double)its * width * height / elapsed / 1.0E+9;
+}
+
+int main(int argc, char** argv)
+{
+	double min_time = argc > 1 ? atof(argv[1]) : 0.1;
+	const struct ca_kernel *only = NULL;
+	double copy_gbs, triad_gbs;
+	int failed = 0, thread_max = max_threads();
+
+	if (argc > 2 && (only = ca_kernel_find(argv[2])) == NULL) {
+		fprintf(stderr, "unknown kernel '%s'\n", argv[2]);
+		return EXIT_FAILURE;
+	}
+
+	stream_probe(&copy_gbs, &triad_gbs);
+	printf("stream: copy %.2f GB/s, triad %.2f GB/s, %d threads\n",
+		copy_gbs, triad_gbs, thread_max);
+	printf("roofline: %.2f GCUPS at %.0f bytes per cell update (copy bandwidth)\n\n",
+		copy_gbs / BYTES_PER_CELL, BYTES_PER_CELL);
+
+	printf("%-10s %6s %6s %8s %5s %7s %10s %8s\n",
+		"kernel", "width", "height", "level", "thr", "check", "GCUPS", "%roof");
+
+	for (int w = 0; w < NUM_ELEMS(widths); w++) {
+		int width = widths[w];
+		size_t stride = width + 2;
+
+		for (int l = 0; l < NUM_ELEMS(levels); l++) {
+			int height = levels[l].bytes / (2 * stride) - 2;
+			cell_state_t *from, *to, *ref;
+
+			if (height < 1) {
+				continue;
+			}
+
+			from = malloc((height + 2) * stride);
+			to = malloc((height + 2) * stride);
+			ref = malloc((height + 2) * stride);
+
+			for (int k = 0; k < ca_num_kernels; k++) {
+				const struct ca_kernel *kernel = &ca_kernels[k];
+
+				if (only != NULL && only != kernel) {
+					continue;
+				}
+
+				for (int t = 1; t <= thread_max; t = next_threads(t, thread_max)) {
+					int ok;
+					double gcups;
+
+					set_threads(t);
+					ok = verify(kernel, from, to, ref, stride, width, height);
+					gcups = measure(kernel, from, to, stride, width, height, min_time);
+					failed |= !ok;
+
+					printf("%-10s %6d %6d %8s %5d %7s %10.3f %7.1f%%\n",
+						kernel->name, width, height, levels[l].level, t,
+						ok ? "ok" : "FAILED", gcups,
+						100.0 * gcups / (copy_gbs / BYTES_PER_CELL));
+					fflush(stdout);
+				}
+				set_threads(thread_max);
+			}
+
+			free(from);
+			free(to);
+			free(ref);
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
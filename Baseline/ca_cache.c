@@ -0,0 +1,282 @@
+/*
+ * persistent cache of final hashes and intermediate configurations
+ *
+ * All files of a problem definition share the prefix
+ *
+ * <CA_CACHE_DIR>/ca_<width>_<lines>_<seed>_<rule>
+ *
+ * The index file <prefix>.index lists the cached results, one per line:
+ *
+ * hash TAB <iteration> TAB <hash>
+ * state TAB <iteration>
+ *
+ * The configuration after <iteration> iterations is stored in
+ * <prefix>.<iteration>.state with 8 cells per byte. Every process writes its
+ * own lines into a temporary file that is renamed and added to the index
+ * once all of them succeeded, so the index only lists complete states.
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "ca_common.h"
+#include "ca_kernels.h"
+#include "ca_cache.h"
+
+#if XSIZE % 8 != 0
+#error "bit-packed states need a multiple of 8 cells per line"
+#endif
+
+/* bytes of a bit-packed line (without ghost cells) */
+#define PACKED_LINE_SIZE (XSIZE / 8)
+
+#define CACHE_PATH_SIZE (4096)
+
+/* MD5 hash as hex string including the terminating zero */
+#define CACHE_HASH_SIZE (33)
+
+static const char *cache_dir(void)
+{
+	const char *dir = getenv("CA_CACHE_DIR");
+
+	return dir == NULL || *dir == '\0' ? NULL : dir;
+}
+
+static int cache_rank(void)
+{
+	int rank = 0;
+
+#ifdef MPI_VERSION
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
+	return rank;
+}
+
+/* logical and of ok over all processes */
+static int cache_all(int ok)
+{
+#ifdef MPI_VERSION
+	MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+#endif
+
+	return ok;
+}
+
+static int cache_bcast(int value)
+{
+#ifdef MPI_VERSION
+	MPI_Bcast(&value, 1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+
+	return value;
+}
+
+/* path of a cache file, iteration < 0 for the index */
+static void cache_path(char *path, int num_total_lines, int iteration, const char *suffix)
+{
+	int len = snprintf(path, CACHE_PATH_SIZE, "%s/ca_%d_%d_%d_%03x", cache_dir(),
+		XSIZE, num_total_lines, CA_DEFAULT_SEED, ca_rule_id());
+
+	if (iteration >= 0) {
+		len += snprintf(path + len, CACHE_PATH_SIZE - len, ".%d", iteration);
+	}
+	snprintf(path + len, CACHE_PATH_SIZE - len, "%s", suffix);
+}
+
+/* latest state not after its and the hash after its (empty if unknown) */
+static int cache_lookup(int num_total_lines, int its, char *hash)
+{
+	char path[CACHE_PATH_SIZE], line[128], kind[16], value[CACHE_HASH_SIZE];
+	int latest = 0, iteration, fields;
+	FILE *index;
+
+	*hash = '\0';
+	cache_path(path, num_total_lines, -1, ".index");
+	index = fopen(path, "r");
+	if (index == NULL) {
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), index) != NULL) {
+		fields = sscanf(line, "%15s\t%d\t%32s", kind, &iteration, value);
+
+		if (fields == 3 && strcmp(kind, "hash") == 0 && iteration == its) {
+			strcpy(hash, value);
+		} else if (fields >= 2 && strcmp(kind, "state") == 0
+				&& iteration <= its && iteration > latest) {
+			latest = iteration;
+		}
+	}
+
+	fclose(index);
+
+	return latest;
+}
+
+static void cache_append(int num_total_lines, const char *entry)
+{
+	char path[CACHE_PATH_SIZE];
+	FILE *index;
+
+	cache_path(path, num_total_lines, -1, ".index");
+	index = fopen(path, "a");
+	if (index == NULL) {
+		perror(path);
+		return;
+	}
+	fputs(entry, index);
+	fclose(index);
+}
+
+int ca_cache_answer(int num_total_lines, int its)
+{
+	char hash[CACHE_HASH_SIZE] = "";
+	int found = 0;
+
+	if (cache_dir() == NULL || !ca_env_long("CA_CACHE_ANSWER", 0)) {
+		return 0;
+	}
+
+	if (cache_rank() == 0) {
+		cache_lookup(num_total_lines, its, hash);
+		found = *hash != '\0';
+		/* no time, the line must not be taken for a measurement */
+		if (found) {
+			printf("cached\t%s\n", hash);
+		}
+	}
+
+	return cache_bcast(found);
+}
+
+int ca_cache_resume(int num_total_lines, int its, line_t *buf,
+		int num_local_lines, int global_first_line)
+{
+	char path[CACHE_PATH_SIZE], hash[CACHE_HASH_SIZE];
+	size_t size = (size_t)num_local_lines * PACKED_LINE_SIZE;
+	uint8_t *packed;
+	struct stat st;
+	int iteration = 0, ok = 0, fd;
+
+	if (cache_dir() == NULL) {
+		return 0;
+	}
+
+	if (cache_rank() == 0) {
+		iteration = cache_lookup(num_total_lines, its, hash);
+	}
+	iteration = cache_bcast(iteration);
+	if (iteration == 0) {
+		return 0;
+	}
+
+	packed = malloc(size + 1);
+	cache_path(path, num_total_lines, iteration, ".state");
+	fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		ok = fstat(fd, &st) == 0
+			&& st.st_size == (off_t)num_total_lines * PACKED_LINE_SIZE
+			&& pread(fd, packed, size, (off_t)global_first_line * PACKED_LINE_SIZE)
+				== (ssize_t)size;
+		close(fd);
+	}
+
+	/* buf stays untouched unless all processes read their lines */
+	if (!cache_all(ok)) {
+		if (cache_rank() == 0) {
+			fprintf(stderr, "%s: unusable cached state\n", path);
+		}
+		free(packed);
+		return 0;
+	}
+
+	for (int y = 0; y < num_local_lines; y++) {
+		for (int x = 0; x < XSIZE; x++) {
+			buf[y + 1][x + 1] = (packed[y * PACKED_LINE_SIZE + x / 8] >> (x % 8)) & 1;
+		}
+	}
+	free(packed);
+
+	if (cache_rank() == 0) {
+		fprintf(stderr, "resumed from cached iteration %d\n", iteration);
+	}
+
+	return iteration;
+}
+
+int ca_cache_checkpoint_interval(void)
+{
+	long interval = ca_env_long("CA_CACHE_CHECKPOINT", 0);
+
+	return cache_dir() == NULL || interval <= 0 ? 0 : (int)interval;
+}
+
+int ca_cache_is_checkpoint(int interval, int iteration, int its)
+{
+	return interval > 0 && iteration > 0 && (iteration % interval == 0 || iteration == its);
+}
+
+void ca_cache_checkpoint(int num_total_lines, int iteration, line_t *buf,
+		int num_local_lines, int global_first_line)
+{
+	char path[CACHE_PATH_SIZE], tmp_path[CACHE_PATH_SIZE], entry[64];
+	size_t size = (size_t)num_local_lines * PACKED_LINE_SIZE;
+	uint8_t *packed;
+	int ok = 0, fd;
+
+	packed = calloc(size + 1, 1);
+	for (int y = 0; y < num_local_lines; y++) {
+		for (int x = 0; x < XSIZE; x++) {
+			packed[y * PACKED_LINE_SIZE + x / 8] |= (buf[y + 1][x + 1] & 1) << (x % 8);
+		}
+	}
+
+	cache_path(path, num_total_lines, iteration, ".state");
+	cache_path(tmp_path, num_total_lines, iteration, ".state.tmp");
+	fd = open(tmp_path, O_WRONLY | O_CREAT, 0644);
+	if (fd >= 0) {
+		ok = pwrite(fd, packed, size, (off_t)global_first_line * PACKED_LINE_SIZE)
+			== (ssize_t)size;
+		ok = close(fd) == 0 && ok;
+	}
+	free(packed);
+
+	ok = cache_all(ok);
+	if (cache_rank() == 0) {
+		if (ok && rename(tmp_path, path) == 0) {
+			snprintf(entry, sizeof(entry), "state\t%d\n", iteration);
+			cache_append(num_total_lines, entry);
+		} else {
+			fprintf(stderr, "%s: could not store the state\n", tmp_path);
+			unlink(tmp_path);
+		}
+	}
+}
+
+void ca_cache_store_hash(int num_total_lines, int its, const char *hash)
+{
+	char cached[CACHE_HASH_SIZE], entry[64 + CACHE_HASH_SIZE];
+
+	if (cache_dir() == NULL) {
+		return;
+	}
+
+	cache_lookup(num_total_lines, its, cached);
+	if (*cached == '\0') {
+		snprintf(entry, sizeof(entry), "hash\t%d\t%s\n", its, hash);
+		cache_append(num_total_lines, entry);
+	} else if (strcmp(cached, hash) != 0) {
+		fprintf(stderr, "hash after %d iterations differs from the cached one %s\n",
+			its, cached);
+	}
+}
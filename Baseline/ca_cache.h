@@ -0,0 +1,52 @@
+#ifndef CA_CACHE_H
+#define CA_CACHE_H
+
+/*
+ * persistent cache of final hashes and intermediate configurations
+ *
+ * Enabled by setting CA_CACHE_DIR. Entries are keyed by the problem
+ * definition (width, lines, seed and transition rule) and the iteration,
+ * but not by the kernel, so all kernels and drivers share them.
+ * CA_CACHE_CHECKPOINT=n additionally stores the configuration every n
+ * iterations and after the last one (bit-packed), later runs of the same
+ * configuration resume from the latest state not after their iterations.
+ * CA_CACHE_ANSWER=1 prints a cached hash instead of simulating.
+ */
+
+#include "ca_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* If CA_CACHE_ANSWER=1 and the hash after its iterations is cached, print it
+ * as "cached<TAB><hash>" (regardless of CA_PRINT_HASH) and return non-zero.
+ * Collective in MPI builds. */
+int ca_cache_answer(int num_total_lines, int its);
+
+/* iteration of the latest cached configuration not after its, loaded into
+ * the lines [1, num_local_lines] of buf (the global lines from
+ * global_first_line on). Returns 0 and leaves buf untouched if there is no
+ * usable one. Collective in MPI builds. */
+int ca_cache_resume(int num_total_lines, int its, line_t *buf,
+		int num_local_lines, int global_first_line);
+
+/* interval of the checkpoints (CA_CACHE_CHECKPOINT), 0 if none are stored */
+int ca_cache_checkpoint_interval(void);
+
+/* non-zero if the configuration after iteration (of its) is a checkpoint */
+int ca_cache_is_checkpoint(int interval, int iteration, int its);
+
+/* store the configuration after iteration. Collective in MPI builds. */
+void ca_cache_checkpoint(int num_total_lines, int iteration, line_t *buf,
+		int num_local_lines, int global_first_line);
+
+/* store the hash after its iterations, warns if it differs from a cached
+ * one. Called by a single process. */
+void ca_cache_store_hash(int num_total_lines, int its, const char *hash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CA_CACHE_H */
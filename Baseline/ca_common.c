@@ -10,18 +10,20 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include "openssl/md5.h"
 #include "openssl/evp.h"
 
-#include "ca_common.h"
-#include "random.h"
-
 #ifdef USE_MPI
 #include <mpi.h>
 #endif
 
+#include "ca_common.h"
+#include "ca_mem.h"
+#include "random.h"
+
 /* determine random integer between 0 and n-1 */
 #define randInt(n) ((int)(nextRandomLEcuyer() * n))
 
@@ -35,12 +37,47 @@ void ca_init(int argc, char** argv, int *lines, int *its)
 	assert(*lines > 0);
 }
 
+long ca_env_long(const char *name, long default_value)
+{
+	const char *value = getenv(name);
+
+	if (value == NULL || *value == '\0') {
+		return default_value;
+	}
+
+	return atol(value);
+}
+
+double ca_env_double(const char *name, double default_value)
+{
+	const char *value = getenv(name);
+	char *end;
+	double result;
+
+	if (value == NULL || *value == '\0') {
+		return default_value;
+	}
+
+	result = strtod(value, &end);
+	if (end == value || *end != '\0') {
+		fprintf(stderr, "%s: not a number: '%s', using %g\n", name, value, default_value);
+		return default_value;
+	}
+
+	return result;
+}
+
 /* random starting configuration */
 void ca_init_config(line_t *buf, int lines, int skip_lines)
+{
+	ca_init_config_seeded(buf, lines, skip_lines, CA_DEFAULT_SEED);
+}
+
+void ca_init_config_seeded(line_t *buf, int lines, int skip_lines, int seed)
 {
 	volatile int scratch;
 
-	initRandomLEcuyer(424243);
+	initRandomLEcuyer(seed);
 
 	/* let the RNG spin for some rounds (used for distributed initialization) */
 	for (int y = 1;  y <= skip_lines;  y++) {
@@ -49,6 +86,11 @@ void ca_init_config(line_t *buf, int lines, int skip_lines)
 		}
 	}
 
+	ca_init_config_next(buf, lines);
+}
+
+void ca_init_config_next(line_t *buf, int lines)
+{
 	for (int y = 1;  y <= lines;  y++) {
 		for (int x = 1;  x <= XSIZE;  x++) {
 			buf[y][x] = randInt(100) >= 50;
@@ -69,9 +111,15 @@ static char* ca_buffer_to_hex_str(const uint8_t* buf, size_t buf_size)
   return retval;
 }
 
-static void ca_print_hash_and_time(const char *hash, const double time)
+/* the hash is only printed on request (CA_PRINT_HASH=1), so timing runs keep
+ * their output format */
+void ca_print_hash_and_time(const char *hash, const double time)
 {
-	printf("%.3f s\n", time);
+	if (ca_env_long("CA_PRINT_HASH", 0)) {
+		printf("%.3f s\t%s\n", time, hash);
+	} else {
+		printf("%.3f s\n", time);
+	}
 }
 
 static void ca_clean_ghost_zones(line_t *buf, int lines)
@@ -82,28 +130,56 @@ static void ca_clean_ghost_zones(line_t *buf, int lines)
 	}
 }
 
-void ca_hash_and_report(line_t *buf, int lines, double time_in_s)
+struct ca_hash {
+	EVP_MD_CTX *ctx;
+};
+
+struct ca_hash *ca_hash_begin(void)
 {
-	uint8_t hash[MD5_DIGEST_LENGTH];
-	uint32_t md_len;
-	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
-	EVP_DigestInit_ex(ctx, EVP_md5(), NULL);
+	struct ca_hash *hash = malloc(sizeof(*hash));
+
+	hash->ctx = EVP_MD_CTX_new();
+	EVP_DigestInit_ex(hash->ctx, EVP_md5(), NULL);
+
+	return hash;
+}
 
+void ca_hash_update(struct ca_hash *hash, line_t *buf, int lines)
+{
 	ca_clean_ghost_zones(buf, lines);
+	EVP_DigestUpdate(hash->ctx, buf, lines * sizeof(*buf));
+}
+
+char *ca_hash_end(struct ca_hash *hash)
+{
+	uint8_t digest[MD5_DIGEST_LENGTH];
+	uint32_t md_len;
+
+	EVP_DigestFinal_ex(hash->ctx, digest, &md_len);
+	EVP_MD_CTX_free(hash->ctx);
+	free(hash);
+
+	return ca_buffer_to_hex_str(digest, MD5_DIGEST_LENGTH);
+}
+
+char *ca_hash_str(line_t *buf, int lines)
+{
+	struct ca_hash *hash = ca_hash_begin();
 
-	EVP_DigestUpdate(ctx, buf, lines * sizeof(*buf));
-	EVP_DigestFinal_ex(ctx, hash, &md_len);
+	ca_hash_update(hash, buf, lines);
 
-	char* hash_str = ca_buffer_to_hex_str(hash, MD5_DIGEST_LENGTH);
+	return ca_hash_end(hash);
+}
+
+void ca_hash_and_report(line_t *buf, int lines, double time_in_s)
+{
+	char* hash_str = ca_hash_str(buf, lines);
 	ca_print_hash_and_time(hash_str, time_in_s);
 	free(hash_str);
-
-	EVP_MD_CTX_free(ctx);
 }
 
 #ifdef MPI_VERSION /* defined by mpi.h */
 
-static int num_remainder_procs;
 #ifdef USE_MPI_TOPOLOGY
 static MPI_Comm topo_comm;
 #endif
@@ -111,11 +187,14 @@ static MPI_Comm topo_comm;
 void ca_mpi_init(int num_procs, int rank, int num_total_lines,
 		int *num_local_lines, int *global_first_line)
 {
+	int num_remainder_procs;
+
 	*num_local_lines = num_total_lines / num_procs;
 	*global_first_line = rank * (*num_local_lines);
 
 
-	/* if work cannot be distributed equally, distribute the remaining lines equally */
+	/* if work cannot be distributed equally, distribute the remaining lines equally.
+	 * With less lines than processes, the last processes do not get any line. */
 	num_remainder_procs = num_total_lines % num_procs;
 	if (rank < num_remainder_procs) {
 		(*num_local_lines)++;
@@ -130,55 +209,196 @@ void ca_mpi_init(int num_procs, int rank, int num_total_lines,
 #endif
 }
 
+#define TAG_REBALANCE_UP (0xBA1)
+#define TAG_REBALANCE_DOWN (0xBA2)
+#define TAG_REBALANCE_HALO_UP (0xBA3)
+#define TAG_REBALANCE_HALO_DOWN (0xBA4)
+
+/* relative imbalance of the compute times below which the partition is kept */
+#define REBALANCE_TOLERANCE (0.05)
+
+int ca_mpi_rebalance(line_t **from, line_t **to, int *num_local_lines,
+		int *global_first_line, double compute_time, int num_procs)
+{
+	int rank, num_total_lines = 0, new_num_lines, keep_first, keep_last;
+	int shift_upper, shift_lower, num_reqs = 0;
+	double local[2] = { *num_local_lines, compute_time };
+	double *all = malloc(2 * num_procs * sizeof(*all));
+	double speed_sum = 0.0, min_time = 1.0E+30, max_time = 0.0, ideal = 0.0;
+	int *old_first = malloc((num_procs + 1) * sizeof(*old_first));
+	int *new_first = malloc((num_procs + 1) * sizeof(*new_first));
+	line_t *new_from;
+	MPI_Request req[4];
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Allgather(local, 2, MPI_DOUBLE, all, 2, MPI_DOUBLE, MPI_COMM_WORLD);
+
+	/* all processes derive the same new partition from the gathered data */
+	for (int i = 0; i < num_procs; i++) {
+		double lines = all[2 * i], time = all[2 * i + 1] > 0 ? all[2 * i + 1] : 1.0E-9;
+
+		old_first[i] = num_total_lines;
+		num_total_lines += (int)lines;
+		speed_sum += lines / time;
+		min_time = time < min_time ? time : min_time;
+		max_time = time > max_time ? time : max_time;
+	}
+	old_first[num_procs] = new_first[num_procs] = num_total_lines;
+
+	if (max_time - min_time <= REBALANCE_TOLERANCE * max_time) {
+		free(all);
+		free(old_first);
+		free(new_first);
+		return 0;
+	}
+
+	/* ideal boundaries are proportional to the speed (lines per second) of the
+	 * processes. Every boundary moves by less than half of the lines of both
+	 * adjacent processes, so lines only move between neighbors and every
+	 * process keeps at least one line. Line 0 stays on rank 0. */
+	new_first[0] = 0;
+	for (int i = 1; i < num_procs; i++) {
+		int lines_above = old_first[i] - old_first[i - 1];
+		int lines_below = old_first[i + 1] - old_first[i];
+		int max_shift = ((lines_above < lines_below ? lines_above : lines_below) - 1) / 2;
+		int shift;
+
+		ideal += num_total_lines * (all[2 * (i - 1)] /
+			(all[2 * (i - 1) + 1] > 0 ? all[2 * (i - 1) + 1] : 1.0E-9)) / speed_sum;
+		shift = (int)(ideal + 0.5) - old_first[i];
+		shift = shift > max_shift ? max_shift : (shift < -max_shift ? -max_shift : shift);
+		new_first[i] = old_first[i] + shift;
+	}
+
+	/* positive shifts move lines up to the previous process */
+	shift_upper = new_first[rank] - old_first[rank];
+	shift_lower = new_first[rank + 1] - old_first[rank + 1];
+	new_num_lines = new_first[rank + 1] - new_first[rank];
+	new_from = ca_mem_alloc_config(new_num_lines);
+
+	if (shift_upper < 0) {
+		MPI_Irecv(new_from[1], -shift_upper * LINE_SIZE, CA_MPI_CELL_DATATYPE,
+			rank - 1, TAG_REBALANCE_DOWN, MPI_COMM_WORLD, &req[num_reqs++]);
+	} else if (shift_upper > 0) {
+		MPI_Isend((*from)[1], shift_upper * LINE_SIZE, CA_MPI_CELL_DATATYPE,
+			rank - 1, TAG_REBALANCE_UP, MPI_COMM_WORLD, &req[num_reqs++]);
+	}
+	if (shift_lower > 0) {
+		MPI_Irecv(new_from[new_num_lines - shift_lower + 1], shift_lower * LINE_SIZE,
+			CA_MPI_CELL_DATATYPE, rank + 1, TAG_REBALANCE_UP, MPI_COMM_WORLD, &req[num_reqs++]);
+	} else if (shift_lower < 0) {
+		MPI_Isend((*from)[*num_local_lines + shift_lower + 1], -shift_lower * LINE_SIZE,
+			CA_MPI_CELL_DATATYPE, rank + 1, TAG_REBALANCE_DOWN, MPI_COMM_WORLD, &req[num_reqs++]);
+	}
+
+	/* lines staying on this process (global indices) */
+	keep_first = new_first[rank] > old_first[rank] ? new_first[rank] : old_first[rank];
+	keep_last = new_first[rank + 1] < old_first[rank + 1] ? new_first[rank + 1] : old_first[rank + 1];
+	memcpy(new_from[1 + keep_first - new_first[rank]], (*from)[1 + keep_first - old_first[rank]],
+		(keep_last - keep_first) * sizeof(line_t));
+
+	MPI_Waitall(num_reqs, req, MPI_STATUSES_IGNORE);
+
+	ca_mem_free(*from);
+	ca_mem_free(*to);
+	*from = new_from;
+	*to = ca_mem_alloc_config(new_num_lines);
+	*num_local_lines = new_num_lines;
+	*global_first_line = new_first[rank];
+
+	/* exchange ghost zones for the new partition */
+	MPI_Sendrecv(
+		new_from[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+		PREV_PROC(rank, num_procs), TAG_REBALANCE_HALO_UP,
+		new_from[new_num_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+		SUCC_PROC(rank, num_procs), TAG_REBALANCE_HALO_UP, MPI_COMM_WORLD,
+		MPI_STATUS_IGNORE);
+	MPI_Sendrecv(
+		new_from[new_num_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+		SUCC_PROC(rank, num_procs), TAG_REBALANCE_HALO_DOWN,
+		new_from[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+		PREV_PROC(rank, num_procs), TAG_REBALANCE_HALO_DOWN, MPI_COMM_WORLD,
+		MPI_STATUS_IGNORE);
+
+	free(all);
+	free(old_first);
+	free(new_first);
+
+	return 1;
+}
+
 #define TAG_RESULT (0xCAFE)
 
-void ca_mpi_hash_and_report(line_t* local_buf, int num_local_lines,
-		int num_total_lines, int num_procs, double time_in_s)
+char *ca_mpi_hash_str(line_t *local_buf, int num_local_lines, MPI_Comm comm)
 {
-	int i, rank, num_lines = num_local_lines, count;
+	int i, rank, num_procs, max_lines = 0, *num_lines = NULL;
 	uint32_t md_len;
 	uint8_t hash[MD5_DIGEST_LENGTH];
+	line_t *recv_buf;
+	char *hash_str = NULL;
 
-	EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &num_procs);
 
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    if (rank == 0) {
+	/* the partition may have changed during the simulation (see ca_mpi_rebalance),
+	 * so collect the actual number of lines of all processes */
+	if (rank == 0) {
+		num_lines = malloc(num_procs * sizeof(*num_lines));
+	}
+	MPI_Gather(&num_local_lines, 1, MPI_INT, num_lines, 1, MPI_INT, 0, comm);
+
+	if (rank == 0) {
+		EVP_MD_CTX *ctx = EVP_MD_CTX_new();
 
 		EVP_DigestInit_ex(ctx, EVP_md5(), NULL);
-		count = num_local_lines;
 		ca_clean_ghost_zones(local_buf + 1, num_local_lines);
-	    /* insert our own data into MD5 hash */
+		/* insert our own data into MD5 hash */
 
 		EVP_DigestUpdate(ctx, local_buf + 1, num_local_lines * sizeof(line_t));
 
-	    /* recieve partial results from all other processes in our local buffer and
-		 * update the hash. Our buffer is garanteed to have the maximum required
-	     * size in any case (see partioning above) */
+		/* recieve partial results from all other processes in a buffer fitting
+		 * the largest one and update the hash. Processes without lines are skipped. */
 		for (i = 1; i < num_procs; i++) {
-			num_lines = num_total_lines / num_procs;
-			if (i < num_remainder_procs) {
-				num_lines++;
+			max_lines = num_lines[i] > max_lines ? num_lines[i] : max_lines;
+		}
+		recv_buf = ca_mem_alloc(CA_MEM_REPORT, max_lines * sizeof(*recv_buf));
+
+		for (i = 1; i < num_procs; i++) {
+			if (num_lines[i] == 0) {
+				continue;
 			}
-			count += num_lines;
 			MPI_Recv(
-				local_buf, num_lines * LINE_SIZE, CA_MPI_CELL_DATATYPE,
-				i, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+				recv_buf, num_lines[i] * LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				i, TAG_RESULT, comm, MPI_STATUS_IGNORE);
 
-			ca_clean_ghost_zones(local_buf, num_lines);
-			EVP_DigestUpdate(ctx, local_buf, num_lines * sizeof(line_t));
+			ca_clean_ghost_zones(recv_buf, num_lines[i]);
+			EVP_DigestUpdate(ctx, recv_buf, num_lines[i] * sizeof(line_t));
 		}
 
 		EVP_DigestFinal_ex(ctx, hash, &md_len);
 
-		char* hash_str = ca_buffer_to_hex_str(hash, MD5_DIGEST_LENGTH);
-		ca_print_hash_and_time(hash_str, time_in_s);
+		hash_str = ca_buffer_to_hex_str(hash, MD5_DIGEST_LENGTH);
 
-		free(hash_str);
+		ca_mem_free(recv_buf);
+		free(num_lines);
 		EVP_MD_CTX_free(ctx);
-	} else {
+	} else if (num_local_lines > 0) {
 		MPI_Send(
 			local_buf[1], num_local_lines * LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			0, TAG_RESULT, MPI_COMM_WORLD);
+			0, TAG_RESULT, comm);
+	}
+
+	return hash_str;
+}
+
+void ca_mpi_hash_and_report(line_t* local_buf, int num_local_lines,
+		int num_total_lines, int num_procs, double time_in_s)
+{
+	char *hash_str = ca_mpi_hash_str(local_buf, num_local_lines, MPI_COMM_WORLD);
+
+	if (hash_str != NULL) {
+		ca_print_hash_and_time(hash_str, time_in_s);
+		free(hash_str);
 	}
 
 #ifdef USE_MPI_TOPOLOGY
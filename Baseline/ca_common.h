@@ -33,9 +33,34 @@ extern "C" {
 typedef uint8_t cell_state_t;
 typedef cell_state_t line_t[XSIZE + 2];
 
+/* seed of the random starting configuration of ca_init_config */
+#define CA_DEFAULT_SEED 424243
+
 void ca_init(int argc, char** argv, int *lines, int *its);
 void ca_init_config(line_t *buf, int lines, int skip_lines);
+void ca_init_config_seeded(line_t *buf, int lines, int skip_lines, int seed);
+/* the next lines of the configuration started by the last ca_init_config call,
+ * e.g. to initialize it in chunks */
+void ca_init_config_next(line_t *buf, int lines);
 void ca_hash_and_report(line_t *buf, int lines, double time_in_s);
+void ca_print_hash_and_time(const char *hash, double time);
+
+/* MD5 hash of lines (without ghost cells) as hex string, free after use */
+char *ca_hash_str(line_t *buf, int lines);
+
+/* the same hash over consecutive chunks of lines: ca_hash_update cleans the
+ * ghost cells of buf, ca_hash_end frees the state and returns the hex string */
+struct ca_hash;
+struct ca_hash *ca_hash_begin(void);
+void ca_hash_update(struct ca_hash *hash, line_t *buf, int lines);
+char *ca_hash_end(struct ca_hash *hash);
+
+/* integer value of an environment variable, default_value if unset or empty */
+long ca_env_long(const char *name, long default_value);
+
+/* floating point value of an environment variable, default_value if unset or
+ * empty, warns and returns default_value if it is not a number */
+double ca_env_double(const char *name, double default_value);
 
 #ifdef __cplusplus
 }
@@ -54,6 +79,21 @@ void ca_mpi_init(int num_procs, int rank, int num_total_lines,
 void ca_mpi_hash_and_report(line_t* local_buf, int num_local_lines,
 		int num_total_lines, int num_procs, double time_in_s);
 
+/* hash of the configuration distributed over comm (local_buf including the
+ * ghost zones). Collective, returns the hex string on rank 0 of comm (free
+ * after use) and NULL on all other processes. */
+#ifdef MPI_VERSION
+char *ca_mpi_hash_str(line_t *local_buf, int num_local_lines, MPI_Comm comm);
+#endif
+
+/* shift lines between neighboring processes (all of them owning lines)
+ * according to the compute time measured on each one. from and to are
+ * reallocated (see ca_mem_alloc_config) and the ghost zones of from are
+ * exchanged. Collective,
+ * returns non-zero if the partition changed. */
+int ca_mpi_rebalance(line_t **from, line_t **to, int *num_local_lines,
+		int *global_first_line, double compute_time, int num_procs);
+
 #endif /* USE_MPI */
 
 
@@ -0,0 +1,385 @@
+/*
+ * compute kernels for the cellular automaton
+ *
+ * all kernels implement the same transition and produce bit-identical
+ * results, they only differ in the way the neighborhood is evaluated.
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ca_common.h"
+#include "ca_kernels.h"
+
+/* annealing rule from ChoDro96 page 34
+ * the table is used to map the number of nonzero
+ * states in the neighborhood to the new state
+ */
+static const cell_state_t anneal[10] = {0, 0, 0, 0, 1, 0, 1, 1, 1, 1};
+
+/* cell x of line y in a configuration with lines stride bytes apart */
+#define CELL(a, stride, x, y) ((a)[(size_t)(y) * (stride) + (x)])
+
+/* anneal as bit mask, bit n is the new state for n nonzero neighbors
+ * (all states are 0 or 1) */
+static inline unsigned int anneal_mask(void)
+{
+	unsigned int mask = 0;
+
+	for (int n = 0; n < 10; n++) {
+		mask |= (unsigned int)anneal[n] << n;
+	}
+
+	return mask;
+}
+
+/* Kernels are written for arbitrary stride and width. The wrapper lets the
+ * compiler specialize the common case of line_t configurations, so the
+ * drivers get the same code as with compile-time line sizes. */
+#define CA_KERNEL_WRAPPER(name) \
+	static void name(const cell_state_t *from, cell_state_t *to, \
+			size_t stride, int width, int start_line, int lines) \
+	{ \
+		if (stride == LINE_SIZE && width == XSIZE) { \
+			name##_impl(from, to, LINE_SIZE, XSIZE, start_line, lines); \
+		} else { \
+			name##_impl(from, to, stride, width, start_line, lines); \
+		} \
+	}
+
+/* reference kernel: sum up the nine cells of the neighborhood */
+static inline void simulate_impl(const cell_state_t *from, cell_state_t *to,
+		size_t stride, int width, int start_line, int lines)
+{
+	for (int y = start_line; y < start_line + lines; y++) {
+		for (int x = 1; x <= width; x++) {
+			CELL(to, stride, x, y) = anneal[
+				CELL(from, stride, x - 1, y - 1) + CELL(from, stride, x - 1, y) + CELL(from, stride, x - 1, y + 1) +
+				CELL(from, stride, x    , y - 1) + CELL(from, stride, x    , y) + CELL(from, stride, x    , y + 1) +
+				CELL(from, stride, x + 1, y - 1) + CELL(from, stride, x + 1, y) + CELL(from, stride, x + 1, y + 1)];
+		}
+	}
+}
+CA_KERNEL_WRAPPER(simulate)
+
+/* column sums: the vertical sum of three cells is computed once per column
+ * and shared by the three neighborhoods containing it. The table lookup is
+ * replaced by a shift of the rule mask, so both loops vectorize. */
+static inline void colsum_impl(const cell_state_t *from, cell_state_t *to,
+		size_t stride, int width, int start_line, int lines)
+{
+	const unsigned int mask = anneal_mask();
+	uint8_t sum[width + 2];
+
+	for (int y = start_line; y < start_line + lines; y++) {
+		const cell_state_t *up = &CELL(from, stride, 0, y - 1);
+		const cell_state_t *mid = &CELL(from, stride, 0, y);
+		const cell_state_t *down = &CELL(from, stride, 0, y + 1);
+		cell_state_t *out = &CELL(to, stride, 0, y);
+
+		for (int x = 0; x < width + 2; x++) {
+			sum[x] = up[x] + mid[x] + down[x];
+		}
+		for (int x = 1; x <= width; x++) {
+			out[x] = (mask >> (sum[x - 1] + sum[x] + sum[x + 1])) & 1;
+		}
+	}
+}
+CA_KERNEL_WRAPPER(colsum)
+
+/* Lookup tables for windows of three lines and four (lut2) or six (lut4)
+ * columns, giving the new states of the two or four inner cells at once.
+ * The rule only depends on the number of nonzero states, so a window is
+ * indexed by the 2-bit counts of nonzero states of its columns with the
+ * leftmost column in the lowest bits. An entry holds the new states as bytes
+ * in memory order. Each table (512 bytes and 16 KiB) is built from anneal on
+ * first use of its kernel. */
+static uint16_t lut2_table[1 << (2 * 4)];
+static uint32_t lut4_table[1 << (2 * 6)];
+static pthread_once_t lut2_once = PTHREAD_ONCE_INIT;
+static pthread_once_t lut4_once = PTHREAD_ONCE_INIT;
+
+static void lut_fill(uint8_t *table, int columns)
+{
+	const int cells = columns - 2;
+
+	for (uint32_t index = 0; index < (1u << (2 * columns)); index++) {
+		for (int c = 0; c < cells; c++) {
+			table[index * cells + c] = anneal[
+				((index >> (2 * c)) & 3) +
+				((index >> (2 * (c + 1))) & 3) +
+				((index >> (2 * (c + 2))) & 3)];
+		}
+	}
+}
+
+static void lut2_init(void)
+{
+	lut_fill((uint8_t *)lut2_table, 4);
+}
+
+static void lut4_init(void)
+{
+	lut_fill((uint8_t *)lut4_table, 6);
+}
+
+/* the column counts of a line are computed once, the window index is then
+ * rolled along the line. Cells not filling a whole window at the end of the
+ * line are computed from the counts directly. */
+static inline void lut2_impl(const cell_state_t *from, cell_state_t *to,
+		size_t stride, int width, int start_line, int lines)
+{
+	uint8_t count[width + 2];
+
+	pthread_once(&lut2_once, lut2_init);
+
+	for (int y = start_line; y < start_line + lines; y++) {
+		const cell_state_t *up = &CELL(from, stride, 0, y - 1);
+		const cell_state_t *mid = &CELL(from, stride, 0, y);
+		const cell_state_t *down = &CELL(from, stride, 0, y + 1);
+		cell_state_t *out = &CELL(to, stride, 0, y);
+		uint32_t index = 0;
+		int x;
+
+		for (x = 0; x < width + 2; x++) {
+			count[x] = up[x] + mid[x] + down[x];
+		}
+
+		index = count[0] | count[1] << 2;
+		for (x = 1; x + 1 <= width; x += 2) {
+			index |= count[x + 1] << 4 | count[x + 2] << 6;
+			memcpy(&out[x], &lut2_table[index], sizeof(lut2_table[0]));
+			index >>= 4;
+		}
+		for (; x <= width; x++) {
+			out[x] = anneal[count[x - 1] + count[x] + count[x + 1]];
+		}
+	}
+}
+CA_KERNEL_WRAPPER(lut2)
+
+static inline void lut4_impl(const cell_state_t *from, cell_state_t *to,
+		size_t stride, int width, int start_line, int lines)
+{
+	uint8_t count[width + 2];
+
+	pthread_once(&lut4_once, lut4_init);
+
+	for (int y = start_line; y < start_line + lines; y++) {
+		const cell_state_t *up = &CELL(from, stride, 0, y - 1);
+		const cell_state_t *mid = &CELL(from, stride, 0, y);
+		const cell_state_t *down = &CELL(from, stride, 0, y + 1);
+		cell_state_t *out = &CELL(to, stride, 0, y);
+		uint32_t index = 0;
+		int x;
+
+		for (x = 0; x < width + 2; x++) {
+			count[x] = up[x] + mid[x] + down[x];
+		}
+
+		index = count[0] | count[1] << 2;
+		for (x = 1; x + 3 <= width; x += 4) {
+			index |= count[x + 1] << 4 | count[x + 2] << 6 | count[x + 3] << 8 | count[x + 4] << 10;
+			memcpy(&out[x], &lut4_table[index], sizeof(lut4_table[0]));
+			index >>= 8;
+		}
+		for (; x <= width; x++) {
+			out[x] = anneal[count[x - 1] + count[x] + count[x + 1]];
+		}
+	}
+}
+CA_KERNEL_WRAPPER(lut4)
+
+const struct ca_kernel ca_kernels[] = {
+	{ "simulate", simulate },
+	{ "colsum", colsum },
+	{ "lut2", lut2 },
+	{ "lut4", lut4 },
+};
+
+const int ca_num_kernels = sizeof(ca_kernels) / sizeof(ca_kernels[0]);
+
+unsigned int ca_rule_id(void)
+{
+	return anneal_mask();
+}
+
+const struct ca_kernel *ca_kernel_find(const char *name)
+{
+	for (int i = 0; i < ca_num_kernels; i++) {
+		if (strcmp(ca_kernels[i].name, name) == 0) {
+			return &ca_kernels[i];
+		}
+	}
+
+	return NULL;
+}
+
+const struct ca_kernel *ca_kernel_default(void)
+{
+	const char *name = getenv("CA_KERNEL");
+	const struct ca_kernel *kernel;
+
+	if (name == NULL || *name == '\0') {
+		return &ca_kernels[0];
+	}
+
+	kernel = ca_kernel_find(name);
+	if (kernel == NULL) {
+		fprintf(stderr, "unknown kernel '%s', available:", name);
+		for (int i = 0; i < ca_num_kernels; i++) {
+			fprintf(stderr, " %s", ca_kernels[i].name);
+		}
+		fprintf(stderr, "\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return kernel;
+}
+
+void ca_kernel_run(const struct ca_kernel *kernel, const cell_state_t *from,
+		cell_state_t *to, size_t stride, int width, int start_line, int lines)
+{
+	kernel->fn(from, to, stride, width, start_line, lines);
+}
+
+/* lines are distributed like a static schedule of the line loop,
+ * num_threads <= 0 uses the OpenMP default */
+static void ca_kernel_run_threads(const struct ca_kernel *kernel, const cell_state_t *from,
+		cell_state_t *to, size_t stride, int width, int start_line, int lines, int num_threads)
+{
+#ifdef _OPENMP
+	if (num_threads <= 0) {
+		num_threads = omp_get_max_threads();
+	}
+
+	#pragma omp parallel num_threads(num_threads)
+	{
+		int thread = omp_get_thread_num(), team_size = omp_get_num_threads();
+		int first = start_line + (int)((long)lines * thread / team_size);
+		int last = start_line + (int)((long)lines * (thread + 1) / team_size);
+
+		kernel->fn(from, to, stride, width, first, last - first);
+	}
+#else
+	(void)num_threads;
+	kernel->fn(from, to, stride, width, start_line, lines);
+#endif
+}
+
+void ca_kernel_run_omp(const struct ca_kernel *kernel, const cell_state_t *from,
+		cell_state_t *to, size_t stride, int width, int start_line, int lines)
+{
+	ca_kernel_run_threads(kernel, from, to, stride, width, start_line, lines, 0);
+}
+
+void ca_simulate(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines)
+{
+	kernel->fn(from[0], to[0], LINE_SIZE, XSIZE, start_line, lines);
+}
+
+void ca_simulate_omp(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines)
+{
+	ca_kernel_run_omp(kernel, from[0], to[0], LINE_SIZE, XSIZE, start_line, lines);
+}
+
+void ca_boundary(line_t *buf, int lines)
+{
+	for (int y = 0;  y <= lines + 1; y++) {
+		/* copy rightmost column to the buffer column 0 */
+		buf[y][0] = buf[y][XSIZE];
+
+		/* copy leftmost column to the buffer column XSIZE + 1 */
+		buf[y][XSIZE+1] = buf[y][1];
+	}
+}
+
+/* the selected kernel line by line, each new line is counted while it is
+ * still in the cache */
+static void observe_lines(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines, struct ca_observables *obs)
+{
+	uint64_t live = 0, changed = 0;
+
+	for (int y = start_line; y < start_line + lines; y++) {
+		kernel->fn(from[0], to[0], LINE_SIZE, XSIZE, y, 1);
+		for (int x = 1; x <= XSIZE; x++) {
+			live += to[y][x];
+			changed += to[y][x] ^ from[y][x];
+		}
+	}
+
+	obs->live += live;
+	obs->changed += changed;
+}
+
+void ca_simulate_observe(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines, struct ca_observables *obs)
+{
+	observe_lines(kernel, from, to, start_line, lines, obs);
+}
+
+void ca_simulate_observe_omp(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines, struct ca_observables *obs)
+{
+	uint64_t live = 0, changed = 0;
+
+#ifdef _OPENMP
+	#pragma omp parallel for schedule(static) reduction(+:live, changed)
+#endif
+	for (int y = start_line; y < start_line + lines; y++) {
+		struct ca_observables line_obs = { 0, 0 };
+
+		observe_lines(kernel, from, to, y, 1, &line_obs);
+		live += line_obs.live;
+		changed += line_obs.changed;
+	}
+
+	obs->live += live;
+	obs->changed += changed;
+}
+
+/* --------------------- stable C ABI --------------------------------- */
+
+int ca_kernel_count(void)
+{
+	return ca_num_kernels;
+}
+
+int ca_kernel_index(const char *name)
+{
+	const struct ca_kernel *kernel = ca_kernel_find(name);
+
+	return kernel == NULL ? -1 : (int)(kernel - ca_kernels);
+}
+
+const char *ca_kernel_name(int index)
+{
+	return index >= 0 && index < ca_num_kernels ? ca_kernels[index].name : NULL;
+}
+
+int ca_kernel_apply(int index, const cell_state_t *from, cell_state_t *to,
+		size_t stride, int width, int start_line, int lines, int num_threads)
+{
+	if (index < 0 || index >= ca_num_kernels) {
+		return -1;
+	}
+
+	if (num_threads > 1) {
+		ca_kernel_run_threads(&ca_kernels[index], from, to, stride, width,
+			start_line, lines, num_threads);
+	} else {
+		ca_kernel_run(&ca_kernels[index], from, to, stride, width, start_line, lines);
+	}
+
+	return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef CA_KERNELS_H
+#define CA_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ca_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A kernel computes the lines [start_line, start_line + lines) of a
+ * configuration whose lines are stride bytes apart. Every line holds width
+ * cells framed by one ghost cell on either side (index 0 and width + 1).
+ * The lines start_line - 1 and start_line + lines are read as neighbors. */
+typedef void (*ca_kernel_fn)(const cell_state_t *from, cell_state_t *to,
+		size_t stride, int width, int start_line, int lines);
+
+struct ca_kernel {
+	const char *name;
+	ca_kernel_fn fn;
+};
+
+/* all available kernels, the first one is the reference implementation */
+extern const struct ca_kernel ca_kernels[];
+extern const int ca_num_kernels;
+
+/* kernel by name, NULL if there is no such kernel */
+const struct ca_kernel *ca_kernel_find(const char *name);
+
+/* the transition rule as bit mask, bit n is the new state for n nonzero
+ * cells in the neighborhood. The same for all kernels. */
+unsigned int ca_rule_id(void);
+
+/* kernel selected by the environment variable CA_KERNEL, the reference
+ * kernel if unset. Terminates the program for unknown kernel names. */
+const struct ca_kernel *ca_kernel_default(void);
+
+/* run a kernel on a strided configuration, the OpenMP variant distributes
+ * the lines equally among the threads (serial without OpenMP) */
+void ca_kernel_run(const struct ca_kernel *kernel, const cell_state_t *from,
+		cell_state_t *to, size_t stride, int width, int start_line, int lines);
+void ca_kernel_run_omp(const struct ca_kernel *kernel, const cell_state_t *from,
+		cell_state_t *to, size_t stride, int width, int start_line, int lines);
+
+/* shortcuts for configurations made of line_t */
+void ca_simulate(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines);
+void ca_simulate_omp(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines);
+
+/* torus-like boundary for the columns of lines 0 to lines + 1 */
+void ca_boundary(line_t *buf, int lines);
+
+/* in-situ observables of the new configuration */
+struct ca_observables {
+	uint64_t live;    /* cells in state 1 */
+	uint64_t changed; /* cells whose state differs from the old configuration */
+};
+
+/* ca_simulate with kernel, counting the observables of every computed line
+ * right after it, the counts are added to obs */
+void ca_simulate_observe(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines, struct ca_observables *obs);
+void ca_simulate_observe_omp(const struct ca_kernel *kernel, line_t *from, line_t *to,
+		int start_line, int lines, struct ca_observables *obs);
+
+/* Stable C ABI of the shared library libca_kernels.so for foreign callers
+ * (e.g. ccall from the Julia implementation). Kernels are addressed by
+ * their index in ca_kernels, line indices are 0-based, the lines are
+ * stride bytes apart and hold width cells plus the two ghost cells.
+ * ca_kernel_apply uses num_threads OpenMP threads if num_threads > 1 and
+ * returns non-zero for invalid kernel indices. */
+int ca_kernel_count(void);
+int ca_kernel_index(const char *name);
+const char *ca_kernel_name(int index);
+int ca_kernel_apply(int index, const cell_state_t *from, cell_state_t *to,
+		size_t stride, int width, int start_line, int lines, int num_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CA_KERNELS_H */
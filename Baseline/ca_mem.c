@@ -0,0 +1,210 @@
+/*
+ * memory footprint profiling without an external tool
+ *
+ * Every accounted block starts with a header holding the bytes per category,
+ * so ca_mem_free knows what to subtract. The header is as large as the
+ * strictest alignment, so the memory handed out stays aligned like malloc's.
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "ca_common.h"
+#include "ca_mem.h"
+
+#define MEM_MAX_PHASES (8)
+
+/* values of a sample: VmRSS, VmHWM and the accounted peak per category
+ * during the phase */
+#define MEM_RSS (0)
+#define MEM_HWM (1)
+#define MEM_CATEGORY(c) (2 + (c))
+#define MEM_NUM_VALUES (2 + CA_MEM_NUM_CATEGORIES)
+
+#define MIB (1024.0 * 1024.0)
+
+union mem_header {
+	size_t size[CA_MEM_NUM_CATEGORIES];
+	long double align_float;
+	long long align_int;
+	void *align_ptr;
+};
+
+static size_t mem_current[CA_MEM_NUM_CATEGORIES];
+static size_t mem_peak[CA_MEM_NUM_CATEGORIES];
+
+static const char *mem_phase_names[MEM_MAX_PHASES];
+static double mem_samples[MEM_MAX_PHASES][MEM_NUM_VALUES];
+static int mem_num_phases;
+
+static const char *mem_category_names[CA_MEM_NUM_CATEGORIES] = {
+	"grid", "halo", "report"
+};
+
+static void *mem_alloc(const size_t *size)
+{
+	size_t total = sizeof(union mem_header);
+	union mem_header *header;
+
+	for (int c = 0; c < CA_MEM_NUM_CATEGORIES; c++) {
+		total += size[c];
+	}
+
+	header = calloc(1, total);
+	if (header == NULL) {
+		return NULL;
+	}
+
+	for (int c = 0; c < CA_MEM_NUM_CATEGORIES; c++) {
+		header->size[c] = size[c];
+		mem_current[c] += size[c];
+		mem_peak[c] = mem_current[c] > mem_peak[c] ? mem_current[c] : mem_peak[c];
+	}
+
+	return header + 1;
+}
+
+void *ca_mem_alloc(enum ca_mem_category category, size_t size)
+{
+	size_t sizes[CA_MEM_NUM_CATEGORIES] = { 0 };
+
+	sizes[category] = size;
+
+	return mem_alloc(sizes);
+}
+
+line_t *ca_mem_alloc_config(int lines)
+{
+	size_t sizes[CA_MEM_NUM_CATEGORIES] = { 0 };
+
+	sizes[CA_MEM_GRID] = lines * sizeof(line_t);
+	sizes[CA_MEM_HALO] = 2 * sizeof(line_t);
+
+	return mem_alloc(sizes);
+}
+
+void ca_mem_free(void *ptr)
+{
+	union mem_header *header = ptr;
+
+	if (ptr == NULL) {
+		return;
+	}
+
+	header--;
+	for (int c = 0; c < CA_MEM_NUM_CATEGORIES; c++) {
+		mem_current[c] -= header->size[c];
+	}
+	free(header);
+}
+
+/* VmRSS and VmHWM in bytes, 0 if unknown */
+static void mem_sample_status(double *rss, double *hwm)
+{
+	char line[256];
+	long kib;
+	FILE *status = fopen("/proc/self/status", "r");
+
+	*rss = *hwm = 0.0;
+	if (status == NULL) {
+		return;
+	}
+
+	while (fgets(line, sizeof(line), status) != NULL) {
+		if (sscanf(line, "VmRSS: %ld kB", &kib) == 1) {
+			*rss = kib * 1024.0;
+		} else if (sscanf(line, "VmHWM: %ld kB", &kib) == 1) {
+			*hwm = kib * 1024.0;
+		}
+	}
+
+	fclose(status);
+}
+
+void ca_mem_phase(const char *name)
+{
+	double *sample;
+
+	if (!ca_env_long("CA_MEMPROF", 0) || mem_num_phases == MEM_MAX_PHASES) {
+		return;
+	}
+
+	sample = mem_samples[mem_num_phases];
+	mem_sample_status(&sample[MEM_RSS], &sample[MEM_HWM]);
+	for (int c = 0; c < CA_MEM_NUM_CATEGORIES; c++) {
+		sample[MEM_CATEGORY(c)] = mem_peak[c];
+		/* the next phase starts from what is allocated now */
+		mem_peak[c] = mem_current[c];
+	}
+	mem_phase_names[mem_num_phases++] = name;
+}
+
+static void mem_print(const char *who, const char *phase, const double *sample)
+{
+	printf("mem %s phase %s: rss %.3f MiB hwm %.3f MiB", who, phase,
+		sample[MEM_RSS] / MIB, sample[MEM_HWM] / MIB);
+	for (int c = 0; c < CA_MEM_NUM_CATEGORIES; c++) {
+		printf(" %s %.3f MiB", mem_category_names[c], sample[MEM_CATEGORY(c)] / MIB);
+	}
+	printf("\n");
+}
+
+void ca_mem_report(void)
+{
+	int rank = 0, num_procs = 1;
+	double *all = &mem_samples[0][0];
+	double max[MEM_MAX_PHASES][MEM_NUM_VALUES], sum[MEM_MAX_PHASES][MEM_NUM_VALUES];
+	char who[32];
+
+	if (!ca_env_long("CA_MEMPROF", 0)) {
+		return;
+	}
+
+#ifdef MPI_VERSION
+	int num_values = mem_num_phases * MEM_NUM_VALUES;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+
+	if (rank == 0) {
+		all = malloc(num_procs * num_values * sizeof(*all));
+	}
+	MPI_Gather(mem_samples, num_values, MPI_DOUBLE,
+		all, num_values, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+#endif
+
+	if (rank == 0) {
+		memset(max, 0, sizeof(max));
+		memset(sum, 0, sizeof(sum));
+
+		for (int r = 0; r < num_procs; r++) {
+			snprintf(who, sizeof(who), "rank %d", r);
+			for (int p = 0; p < mem_num_phases; p++) {
+				const double *sample = &all[(r * mem_num_phases + p) * MEM_NUM_VALUES];
+
+				mem_print(who, mem_phase_names[p], sample);
+				for (int v = 0; v < MEM_NUM_VALUES; v++) {
+					max[p][v] = sample[v] > max[p][v] ? sample[v] : max[p][v];
+					sum[p][v] += sample[v];
+				}
+			}
+		}
+
+		for (int p = 0; p < mem_num_phases && num_procs > 1; p++) {
+			mem_print("max", mem_phase_names[p], max[p]);
+		}
+		for (int p = 0; p < mem_num_phases && num_procs > 1; p++) {
+			mem_print("sum", mem_phase_names[p], sum[p]);
+		}
+	}
+
+	if (all != &mem_samples[0][0]) {
+		free(all);
+	}
+}
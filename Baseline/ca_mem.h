@@ -0,0 +1,52 @@
+#ifndef CA_MEM_H
+#define CA_MEM_H
+
+/*
+ * memory footprint profiling without an external tool
+ *
+ * Allocations through ca_mem_alloc and ca_mem_alloc_config are accounted per
+ * category. With CA_MEMPROF=1, ca_mem_phase samples the resident set size
+ * (VmRSS) and its peak (VmHWM) of the process from /proc/self/status, which
+ * includes memory not allocated by the application, e.g. MPI buffers.
+ * ca_mem_report prints the samples together with the peak of the accounted
+ * memory during each phase, whereas VmHWM is the peak so far.
+ */
+
+#include <stddef.h>
+
+#include "ca_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum ca_mem_category {
+	CA_MEM_GRID,   /* lines of the configuration */
+	CA_MEM_HALO,   /* ghost lines of the configuration */
+	CA_MEM_REPORT, /* buffers for collecting the results */
+	CA_MEM_NUM_CATEGORIES
+};
+
+/* zero-initialized memory accounted to category, release with ca_mem_free.
+ * The accounting is not thread-safe, allocate outside of parallel regions. */
+void *ca_mem_alloc(enum ca_mem_category category, size_t size);
+
+/* configuration of lines lines plus the two ghost lines, the ghost lines
+ * are accounted as halo */
+line_t *ca_mem_alloc_config(int lines);
+
+void ca_mem_free(void *ptr);
+
+/* sample the memory usage at the end of the phase name (a string literal).
+ * All processes must sample the same phases. */
+void ca_mem_phase(const char *name);
+
+/* print the samples per rank and the maximum and sum over all ranks.
+ * Collective in MPI builds, rank 0 prints for all ranks. */
+void ca_mem_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CA_MEM_H */
@@ -0,0 +1,305 @@
+/*
+ * simulate an ensemble of independent cellular automata with periodic
+ * boundaries (torus-like), e.g. for parameter studies on small configurations
+ *
+ * The members of the ensemble are all combinations of the given numbers of
+ * lines and seeds. The processes are split into groups of CA_ENSEMBLE_GROUP
+ * processes and the members are dealt round-robin to the groups. Groups of a
+ * single process simulate all their members at once with one OpenMP thread
+ * per member, larger groups simulate one member after the other with the
+ * algorithm of ca_mpi_p2p_nb on their communicator.
+ *
+ * command line arguments:
+ * #1: Comma-separated list of numbers of lines
+ * #2: Number of iterations to be simulated
+ * #3: Comma-separated list of seeds (424243 is the seed of all other drivers)
+ *
+ * environment variables:
+ * CA_KERNEL: compute kernel (see ca_kernels.c), default: simulate
+ * CA_ENSEMBLE_GROUP=n: processes per group, default: 1
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+
+#include "ca_common.h"
+#include "ca_kernels.h"
+
+/* tags for communication */
+#define TAG_SEND_UPPER_BOUND (1)
+#define TAG_SEND_LOWER_BOUND (2)
+
+#define TAG_RECV_UPPER_BOUND TAG_SEND_LOWER_BOUND
+#define TAG_RECV_LOWER_BOUND TAG_SEND_UPPER_BOUND
+
+/* MD5 hash as hex string including the terminating zero */
+#define HASH_STR_SIZE (33)
+
+struct member {
+	int lines;
+	int seed;
+};
+
+/* comma-separated list of integers, returns the number of values */
+static int parse_list(const char *arg, int **values)
+{
+	int count = 1;
+	char *end;
+
+	for (const char *ptr = arg; *ptr != '\0'; ptr++) {
+		count += *ptr == ',';
+	}
+
+	*values = malloc(count * sizeof(**values));
+	for (int i = 0; i < count; i++) {
+		(*values)[i] = (int)strtol(arg, &end, 10);
+		arg = end + 1;
+	}
+
+	return count;
+}
+
+/* treat torus like boundary conditions for lines and columns */
+static void boundary(line_t *buf, int lines)
+{
+	/* copy last line to the upper ghost line and first line to the lower one */
+	memcpy(buf[0], buf[lines], sizeof(*buf));
+	memcpy(buf[lines + 1], buf[1], sizeof(*buf));
+
+	ca_boundary(buf, lines);
+}
+
+/* all members of a single process group at once, one thread per member.
+ * The configurations are initialized in advance since the RNG is shared. */
+static void simulate_batch(const struct ca_kernel *kernel, const struct member *members,
+		int num_members, int first_member, int member_stride, int its,
+		double *times, char (*hashes)[HASH_STR_SIZE])
+{
+	int num_batch = 0;
+	int *batch = malloc(num_members * sizeof(*batch));
+	line_t **from, **to;
+
+	for (int m = first_member; m < num_members; m += member_stride) {
+		batch[num_batch++] = m;
+	}
+
+	from = malloc(num_batch * sizeof(*from));
+	to = malloc(num_batch * sizeof(*to));
+	for (int b = 0; b < num_batch; b++) {
+		const struct member *member = &members[batch[b]];
+
+		from[b] = calloc(member->lines + 2, sizeof(**from));
+		to[b] = calloc(member->lines + 2, sizeof(**to));
+		ca_init_config_seeded(from[b], member->lines, 0, member->seed);
+	}
+
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (int b = 0; b < num_batch; b++) {
+		int lines = members[batch[b]].lines;
+		char *hash_str;
+
+		TIME_GET(sim_start);
+		for (int i = 0; i < its; i++) {
+			boundary(from[b], lines);
+			ca_simulate(kernel, from[b], to[b], 1, lines);
+
+			line_t *temp = from[b];
+			from[b] = to[b];
+			to[b] = temp;
+		}
+		TIME_GET(sim_stop);
+
+		times[batch[b]] = TIME_DIFF(sim_start, sim_stop);
+
+		hash_str = ca_hash_str(from[b] + 1, lines);
+		strcpy(hashes[batch[b]], hash_str);
+		free(hash_str);
+
+		free(from[b]);
+		free(to[b]);
+	}
+
+	free(from);
+	free(to);
+	free(batch);
+}
+
+/* a single member distributed over comm (see ca_mpi_p2p_nb.c), the time and
+ * the hash are stored on rank 0 of comm only */
+static void simulate_distributed(const struct ca_kernel *kernel, const struct member *member,
+		int its, MPI_Comm comm, double *time, char *hash)
+{
+	int num_procs, num_ring_procs, local_rank, num_local_lines, num_skip_lines;
+	line_t *from, *to, *temp;
+	char *hash_str;
+
+	MPI_Comm_size(comm, &num_procs);
+	MPI_Comm_rank(comm, &local_rank);
+
+	ca_mpi_init(num_procs, local_rank, member->lines, &num_local_lines, &num_skip_lines);
+
+	/* with less lines than processes, only the ones with lines form the ring */
+	num_ring_procs = num_procs < member->lines ? num_procs : member->lines;
+
+	from = malloc((num_local_lines + 2) * sizeof(*from));
+	to = malloc((num_local_lines + 2) * sizeof(*to));
+
+	ca_init_config_seeded(from, num_local_lines, num_skip_lines, member->seed);
+
+	/* initial exchange, idle processes skip the whole computation */
+	if (num_local_lines == 0) {
+		its = 0;
+	} else {
+		MPI_Sendrecv(
+				from[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_SEND_UPPER_BOUND,
+				from[num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_RECV_LOWER_BOUND, comm,
+				MPI_STATUS_IGNORE);
+		MPI_Sendrecv(
+				from[num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_SEND_LOWER_BOUND,
+				from[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_RECV_UPPER_BOUND, comm,
+				MPI_STATUS_IGNORE);
+	}
+
+	TIME_GET(sim_start);
+	for (int i = 0; i < its; i++) {
+		MPI_Request req[4];
+
+		ca_boundary(from, num_local_lines);
+
+		MPI_Irecv(to[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_RECV_UPPER_BOUND, comm, &req[0]);
+		MPI_Irecv(to[num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_RECV_LOWER_BOUND, comm, &req[1]);
+
+		ca_simulate(kernel, from, to, 1, 1);
+		ca_simulate(kernel, from, to, num_local_lines, 1);
+
+		MPI_Isend(to[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_SEND_UPPER_BOUND, comm, &req[2]);
+		MPI_Isend(to[num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_SEND_LOWER_BOUND, comm, &req[3]);
+
+		ca_simulate_omp(kernel, from, to, 2, num_local_lines - 1);
+
+		temp = from;
+		from = to;
+		to = temp;
+
+		MPI_Waitall(4, req, MPI_STATUS_IGNORE);
+	}
+	TIME_GET(sim_stop);
+
+	hash_str = ca_mpi_hash_str(from, num_local_lines, comm);
+	if (hash_str != NULL) {
+		*time = TIME_DIFF(sim_start, sim_stop);
+		strcpy(hash, hash_str);
+		free(hash_str);
+	}
+
+	free(from);
+	free(to);
+}
+
+/* --------------------- measurement ---------------------------------- */
+
+int main(int argc, char** argv)
+{
+	int num_procs, local_rank, group_size, num_groups, group;
+	int num_line_counts, num_seeds, num_members, its, *line_counts, *seeds;
+	const struct ca_kernel *kernel = ca_kernel_default();
+	struct member *members;
+	double *times, cell_updates = 0.0;
+	char (*hashes)[HASH_STR_SIZE];
+	MPI_Comm group_comm;
+
+	MPI_Init(&argc, &argv);
+
+	MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+	MPI_Comm_rank(MPI_COMM_WORLD, &local_rank);
+
+	if (argc != 4) {
+		if (local_rank == 0) {
+			fprintf(stderr, "usage: %s <lines,...> <iterations> <seed,...>\n", argv[0]);
+		}
+		MPI_Finalize();
+		return EXIT_FAILURE;
+	}
+
+	num_line_counts = parse_list(argv[1], &line_counts);
+	its = atoi(argv[2]);
+	num_seeds = parse_list(argv[3], &seeds);
+
+	num_members = num_line_counts * num_seeds;
+	members = malloc(num_members * sizeof(*members));
+	for (int l = 0; l < num_line_counts; l++) {
+		if (line_counts[l] <= 0) {
+			if (local_rank == 0) {
+				fprintf(stderr, "invalid number of lines: %d\n", line_counts[l]);
+			}
+			MPI_Finalize();
+			return EXIT_FAILURE;
+		}
+		for (int s = 0; s < num_seeds; s++) {
+			members[l * num_seeds + s].lines = line_counts[l];
+			members[l * num_seeds + s].seed = seeds[s];
+		}
+	}
+
+	/* the last group is smaller if the processes cannot be split equally */
+	group_size = (int)ca_env_long("CA_ENSEMBLE_GROUP", 1);
+	group_size = group_size < 1 ? 1 : (group_size > num_procs ? num_procs : group_size);
+	num_groups = (num_procs + group_size - 1) / group_size;
+	group = local_rank / group_size;
+	MPI_Comm_split(MPI_COMM_WORLD, group, local_rank, &group_comm);
+
+	/* results of this group, merged into rank 0 by reductions */
+	times = calloc(num_members, sizeof(*times));
+	hashes = calloc(num_members, sizeof(*hashes));
+
+	MPI_Barrier(MPI_COMM_WORLD);
+	TIME_GET(ensemble_start);
+	if (group_size == 1) {
+		simulate_batch(kernel, members, num_members, group, num_groups, its, times, hashes);
+	} else {
+		for (int m = group; m < num_members; m += num_groups) {
+			simulate_distributed(kernel, &members[m], its, group_comm, &times[m], hashes[m]);
+		}
+	}
+	MPI_Barrier(MPI_COMM_WORLD);
+	TIME_GET(ensemble_stop);
+
+	/* every member is only set on a single process, all others hold zeros */
+	MPI_Reduce(local_rank == 0 ? MPI_IN_PLACE : times, times, num_members,
+		MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+	MPI_Reduce(local_rank == 0 ? MPI_IN_PLACE : hashes, hashes, num_members * HASH_STR_SIZE,
+		MPI_UNSIGNED_CHAR, MPI_BOR, 0, MPI_COMM_WORLD);
+
+	if (local_rank == 0) {
+		double ensemble_time = TIME_DIFF(ensemble_start, ensemble_stop);
+
+		for (int m = 0; m < num_members; m++) {
+			printf("%d lines, seed %d:\t%.3f s\t%s\n",
+				members[m].lines, members[m].seed, times[m], hashes[m]);
+			cell_updates += (double)members[m].lines * XSIZE * its;
+		}
+		printf("%d members, %d groups:\t%.3f s\t%.3f GCUPS\n", num_members, num_groups,
+			ensemble_time, ensemble_time > 0 ? cell_updates / ensemble_time / 1.0E+9 : 0.0);
+	}
+
+	MPI_Comm_free(&group_comm);
+	free(times);
+	free(hashes);
+	free(members);
+	free(line_counts);
+	free(seeds);
+
+	MPI_Finalize();
+
+	return EXIT_SUCCESS;
+}
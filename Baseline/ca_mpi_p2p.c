@@ -9,6 +9,16 @@
  * #1: Number of lines
  * #2: Number of iterations to be simulated
  *
+ * environment variables:
+ * CA_PRINT_HASH=1: print the MD5 hash of the final configuration after the time
+ * CA_KERNEL: compute kernel (see ca_kernels.c), default: simulate or the
+ *            tuned kernel (see ca_tune.h)
+ * CA_TUNE=1: probe kernels and OpenMP threads, store the fastest in CA_TUNE_FILE
+ * CA_MEMPROF=1: report the memory usage after initialization, computation and
+ *               hash gathering (see ca_mem.h)
+ * CA_PERF=1: report hardware performance counters of the compute phase
+ * CA_STREAM_GBS: STREAM bandwidth of a node (GB/s) to relate CA_PERF results to
+ *
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,6 +27,10 @@
 #include <mpi.h>
 
 #include "ca_common.h"
+#include "ca_kernels.h"
+#include "ca_mem.h"
+#include "ca_perf.h"
+#include "ca_tune.h"
 
 /* tags for communication */
 #define TAG_SEND_UPPER_BOUND (1)
@@ -25,43 +39,6 @@
 #define TAG_RECV_UPPER_BOUND TAG_SEND_LOWER_BOUND
 #define TAG_RECV_LOWER_BOUND TAG_SEND_UPPER_BOUND
 
-/* --------------------- CA simulation -------------------------------- */
-
-/* annealing rule from ChoDro96 page 34
- * the table is used to map the number of nonzero
- * states in the neighborhood to the new state
- */
-static const cell_state_t anneal[10] = {0, 0, 0, 0, 1, 0, 1, 1, 1, 1};
-
-/* treat torus like boundary conditions */
-static void boundary(line_t *buf, int lines)
-{
-   for (int y = 0;  y <= lines + 1; y++) {
-      /* copy rightmost column to the buffer column 0 */
-      buf[y][0] = buf[y][XSIZE];
-
-      /* copy leftmost column to the buffer column XSIZE + 1 */
-      buf[y][XSIZE+1] = buf[y][1];
-   }
-
-   /* no wrap of upper/lower boundary, since it is done by exchanged ghost zones */
-}
-
-/* make one simulation iteration with lines lines.
- * old configuration is in from, new one is written to to.
- */
-static void simulate(line_t *from, line_t *to, int lines)
-{
-	#ifdef _OPENMP
-	#pragma omp parallel for
-	#endif
-	for (int y = 1;  y <= lines;  y++) {
-		for (int x = 1;  x <= XSIZE;  x++) {
-			to[y][x] = transition(from, x, y);
-		}
-	}
-}
-
 /* --------------------- measurement ---------------------------------- */
 
 int main(int argc, char** argv)
@@ -80,42 +57,61 @@ int main(int argc, char** argv)
 	ca_mpi_init(num_procs, local_rank, num_total_lines,
 		&num_local_lines, &num_skip_lines);
 
-	line_t *from = calloc((num_local_lines + 2), sizeof(*from));
-	line_t *to = calloc((num_local_lines + 2), sizeof(*to));
+	/* with less lines than processes, only the ones with lines form the ring
+	 * and the idle processes skip the computation */
+	int num_ring_procs = num_procs < num_total_lines ? num_procs : num_total_lines;
+	if (num_local_lines == 0) {
+		its = 0;
+	}
+
+	line_t *from = ca_mem_alloc_config(num_local_lines);
+	line_t *to = ca_mem_alloc_config(num_local_lines);
+	const struct ca_kernel *kernel = ca_tune(num_total_lines, num_local_lines);
 
 	ca_init_config(from, num_local_lines, num_skip_lines);
 
+	ca_mem_phase("init");
+	ca_perf_init();
+
 	/* actual computation */
+	ca_perf_start();
 	TIME_GET(sim_start);
 	for (int i = 0; i < its; i++) {
 		MPI_Sendrecv(
 			from[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			PREV_PROC(local_rank, num_procs), TAG_SEND_UPPER_BOUND,
+			PREV_PROC(local_rank, num_ring_procs), TAG_SEND_UPPER_BOUND,
 			from[num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			SUCC_PROC(local_rank, num_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD,
+			SUCC_PROC(local_rank, num_ring_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD,
 			MPI_STATUS_IGNORE);
 
 		MPI_Sendrecv(
 			from[num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			SUCC_PROC(local_rank, num_procs), TAG_SEND_LOWER_BOUND,
+			SUCC_PROC(local_rank, num_ring_procs), TAG_SEND_LOWER_BOUND,
 			from[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			PREV_PROC(local_rank, num_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD,
+			PREV_PROC(local_rank, num_ring_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD,
 			MPI_STATUS_IGNORE);
 
-		boundary(from, num_local_lines);
-		simulate(from, to, num_local_lines);
+		/* no wrap of upper/lower boundary, since it is done by exchanged ghost zones */
+		ca_boundary(from, num_local_lines);
+		ca_simulate_omp(kernel, from, to, 1, num_local_lines);
 
 		line_t *temp = from;
 		from = to;
 		to = temp;
 	}
 	TIME_GET(sim_stop);
+	ca_perf_stop();
+	ca_mem_phase("compute");
 
 	ca_mpi_hash_and_report(from, num_local_lines, num_total_lines,
 		num_procs, TIME_DIFF(sim_start, sim_stop));
+	ca_mem_phase("hash");
+	ca_mem_report();
+	ca_perf_report((double)num_local_lines * XSIZE * its, TIME_DIFF(sim_start, sim_stop));
+	ca_perf_finalize();
 
-	free(from);
-	free(to);
+	ca_mem_free(from);
+	ca_mem_free(to);
 
 	MPI_Finalize();
 
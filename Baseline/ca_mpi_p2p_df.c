@@ -0,0 +1,205 @@
+/*
+ * simulate a cellular automaton with periodic boundaries (torus-like)
+ * MPI version with a dataflow graph of OpenMP tasks
+ *
+ * The local lines are split into blocks. Computing a block for the next time
+ * step is a task that only depends on the block and its two neighbors at the
+ * current time step, the halo exchange of a time step is a task that depends
+ * on the first and the last block. There is no barrier between time steps,
+ * so blocks run ahead of slow neighbors. The configurations of CA_DF_LEVELS
+ * consecutive time steps are kept, which bounds how far they can run ahead.
+ * Results are bit-identical to ca_mpi_p2p_nb.
+ *
+ * (c) 2016 Steffen Christgau (C99 port, modularization, parallelization)
+ * (c) 1996,1997 Peter Sanders, Ingo Boesnach (original source)
+ *
+ * command line arguments:
+ * #1: Number of lines
+ * #2: Number of iterations to be simulated
+ *
+ * environment variables:
+ * CA_PRINT_HASH=1: print the MD5 hash of the final configuration after the time
+ * CA_KERNEL: compute kernel (see ca_kernels.c), default: simulate
+ * CA_DF_BLOCK=n: lines per block, default: 64
+ * CA_DF_LEVELS=n: number of time steps kept (at least 2), default: 3
+ * CA_MEMPROF=1: report the memory usage after initialization, computation and
+ *               hash gathering (see ca_mem.h)
+ * CA_PERF=1: report hardware performance counters of the compute phase
+ * CA_STREAM_GBS: STREAM bandwidth of a node (GB/s) to relate CA_PERF results to
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+
+#include "ca_common.h"
+#include "ca_kernels.h"
+#include "ca_mem.h"
+#include "ca_perf.h"
+
+/* tags for communication */
+#define TAG_SEND_UPPER_BOUND (1)
+#define TAG_SEND_LOWER_BOUND (2)
+
+#define TAG_RECV_UPPER_BOUND TAG_SEND_LOWER_BOUND
+#define TAG_RECV_LOWER_BOUND TAG_SEND_UPPER_BOUND
+
+/* column wrap of the lines [first, first + lines) */
+static void wrap_lines(line_t *buf, int first, int lines)
+{
+	for (int y = first; y < first + lines; y++) {
+		buf[y][0] = buf[y][XSIZE];
+		buf[y][XSIZE + 1] = buf[y][1];
+	}
+}
+
+/* halo exchange of a time step, spins until completion while letting the
+ * runtime schedule other tasks */
+static void exchange(line_t *buf, int num_local_lines, int rank, int num_procs)
+{
+	MPI_Request req[4];
+	int done = 0;
+
+	MPI_Irecv(buf[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+			PREV_PROC(rank, num_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD, &req[0]);
+	MPI_Irecv(buf[num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+			SUCC_PROC(rank, num_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD, &req[1]);
+	MPI_Isend(buf[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+			PREV_PROC(rank, num_procs), TAG_SEND_UPPER_BOUND, MPI_COMM_WORLD, &req[2]);
+	MPI_Isend(buf[num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+			SUCC_PROC(rank, num_procs), TAG_SEND_LOWER_BOUND, MPI_COMM_WORLD, &req[3]);
+
+	for (;;) {
+		MPI_Testall(4, req, &done, MPI_STATUSES_IGNORE);
+		if (done) {
+			break;
+		}
+		#pragma omp taskyield
+	}
+}
+
+/* --------------------- measurement ---------------------------------- */
+
+int main(int argc, char** argv)
+{
+	int num_total_lines, num_local_lines, num_skip_lines, its;
+	int num_procs, num_ring_procs, local_rank, thread_support;
+	int block_size = (int)ca_env_long("CA_DF_BLOCK", 64);
+	int num_levels = (int)ca_env_long("CA_DF_LEVELS", 3);
+	int num_blocks;
+	const struct ca_kernel *kernel = ca_kernel_default();
+	line_t **levels;
+
+	/* tasks call MPI from any thread, but one after the other */
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &thread_support);
+
+	MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+	MPI_Comm_rank(MPI_COMM_WORLD, &local_rank);
+
+	if (thread_support < MPI_THREAD_SERIALIZED) {
+		if (local_rank == 0) {
+			fprintf(stderr, "MPI_THREAD_SERIALIZED is not supported\n");
+		}
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	}
+
+	ca_init(argc, argv, &num_total_lines, &its);
+
+	ca_mpi_init(num_procs, local_rank, num_total_lines,
+		&num_local_lines, &num_skip_lines);
+
+	/* with less lines than processes, only the ones with lines form the ring */
+	num_ring_procs = num_procs < num_total_lines ? num_procs : num_total_lines;
+
+	block_size = block_size < 1 ? 1 : block_size;
+	num_levels = num_levels < 2 ? 2 : num_levels;
+	num_blocks = (num_local_lines + block_size - 1) / block_size;
+
+	levels = malloc(num_levels * sizeof(*levels));
+	for (int l = 0; l < num_levels; l++) {
+		levels[l] = ca_mem_alloc_config(num_local_lines);
+	}
+
+	ca_init_config(levels[0], num_local_lines, num_skip_lines);
+
+	/* initial exchange, idle processes skip the whole computation */
+	if (num_local_lines == 0) {
+		its = 0;
+	} else {
+		MPI_Sendrecv(
+				levels[0][1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_SEND_UPPER_BOUND,
+				levels[0][num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD,
+				MPI_STATUS_IGNORE);
+		MPI_Sendrecv(
+				levels[0][num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_SEND_LOWER_BOUND,
+				levels[0][0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD,
+				MPI_STATUS_IGNORE);
+	}
+	ca_boundary(levels[0], num_local_lines);
+
+	/* Dependency tokens per time level: the upper ghost line, the blocks and
+	 * the lower ghost line. Writing a level waits for all readers of the
+	 * time step previously stored in it. */
+	char (*token)[num_blocks + 2] = calloc(num_levels, sizeof(*token));
+
+	ca_mem_phase("init");
+	ca_perf_init();
+
+	/* actual computation */
+	ca_perf_start();
+	TIME_GET(sim_start);
+	#pragma omp parallel
+	#pragma omp single
+	{
+		for (int t = 0; t < its; t++) {
+			int cur = t % num_levels, next = (t + 1) % num_levels;
+
+			for (int b = 0; b < num_blocks; b++) {
+				#pragma omp task firstprivate(b, cur, next) \
+					depend(in: token[cur][b], token[cur][b + 1], token[cur][b + 2]) \
+					depend(out: token[next][b + 1])
+				{
+					int first = 1 + b * block_size;
+					int lines = first + block_size > num_local_lines + 1 ?
+						num_local_lines + 1 - first : block_size;
+
+					ca_kernel_run(kernel, levels[cur][0], levels[next][0],
+						LINE_SIZE, XSIZE, first, lines);
+					wrap_lines(levels[next], first, lines);
+				}
+			}
+
+			/* ghost lines of the next time step. The exchanges never run
+			 * concurrently, each one depends on the first block of its time
+			 * step, which in turn depends on the previous exchange. */
+			#pragma omp task firstprivate(next) \
+				depend(in: token[next][1], token[next][num_blocks]) \
+				depend(out: token[next][0], token[next][num_blocks + 1])
+			exchange(levels[next], num_local_lines, local_rank, num_ring_procs);
+		}
+	}
+	TIME_GET(sim_stop);
+	ca_perf_stop();
+	ca_mem_phase("compute");
+
+	ca_mpi_hash_and_report(levels[its % num_levels], num_local_lines, num_total_lines,
+		num_procs, TIME_DIFF(sim_start, sim_stop));
+	ca_mem_phase("hash");
+	ca_mem_report();
+	ca_perf_report((double)num_local_lines * XSIZE * its, TIME_DIFF(sim_start, sim_stop));
+	ca_perf_finalize();
+
+	for (int l = 0; l < num_levels; l++) {
+		ca_mem_free(levels[l]);
+	}
+	free(levels);
+	free(token);
+
+	MPI_Finalize();
+
+	return EXIT_SUCCESS;
+}
@@ -9,12 +9,45 @@
  * #1: Number of lines
  * #2: Number of iterations to be simulated
  *
+ * environment variables:
+ * CA_PRINT_HASH=1: print the MD5 hash of the final configuration after the time
+ * CA_KERNEL: compute kernel (see ca_kernels.c), default: simulate or the
+ *            tuned kernel (see ca_tune.h)
+ * CA_TUNE=1: probe kernels and OpenMP threads, store the fastest in CA_TUNE_FILE
+ * CA_REBALANCE=n: shift lines between neighbors every n iterations according to
+ *                 their compute time (dynamic load balancing), default: 0 (off)
+ * CA_OBSERVE=1: count live and changed cells in every iteration (each line
+ *              right after CA_KERNEL computed it) and write them to
+ *              CA_OBSERVE_FILE, default: ca_observables.txt
+ * CA_STOP_STABLE=1: observe and stop as soon as the configuration does not
+ *                   change anymore (detected one iteration later)
+ * CA_PROGRESS_CHUNK=n: simulate the inner lines in chunks of n lines and test
+ *                      the halo exchange in between to progress it, default: 0
+ *                      (one block)
+ * CA_COMM_REPORT=1: report how much of the halo exchange was hidden behind
+ *                   the computation
+ * CA_CACHE_DIR: directory of the result cache (see ca_cache.h), default: none
+ * CA_CACHE_CHECKPOINT=n: cache the configuration every n iterations (not
+ *                        when observing)
+ * CA_CACHE_ANSWER=1: print the cached hash (labeled "cached", without time)
+ *                   instead of simulating
+ * CA_MEMPROF=1: report the memory usage after initialization, computation and
+ *               hash gathering (see ca_mem.h)
+ * CA_PERF=1: report hardware performance counters of the compute phase
+ * CA_STREAM_GBS: STREAM bandwidth of a node (GB/s) to relate CA_PERF results to
+ *
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mpi.h>
 
+#include "ca_cache.h"
 #include "ca_common.h"
+#include "ca_kernels.h"
+#include "ca_mem.h"
+#include "ca_perf.h"
+#include "ca_tune.h"
 
 /* tags for communication */
 #define TAG_SEND_UPPER_BOUND (1)
@@ -23,132 +56,306 @@
 #define TAG_RECV_UPPER_BOUND TAG_SEND_LOWER_BOUND
 #define TAG_RECV_LOWER_BOUND TAG_SEND_UPPER_BOUND
 
-/* --------------------- CA simulation -------------------------------- */
-
-/* annealing rule from ChoDro96 page 34
- * the table is used to map the number of nonzero
- * states in the neighborhood to the new state
- */
-static const cell_state_t anneal[10] = {0, 0, 0, 0, 1, 0, 1, 1, 1, 1};
+#define OBSERVE_DEFAULT_FILE "ca_observables.txt"
 
-/* treat torus like boundary conditions */
-static void boundary(line_t *buf, int lines)
+/* time series of the observables, written by rank 0 */
+static FILE *observe_open(int rank)
 {
-   for (int y = 0;  y <= lines + 1; y++) {
-      /* copy rightmost column to the buffer column 0 */
-      buf[y][0] = buf[y][XSIZE];
+	const char *name = getenv("CA_OBSERVE_FILE");
+	FILE *file;
 
-      /* copy leftmost column to the buffer column XSIZE + 1 */
-      buf[y][XSIZE+1] = buf[y][1];
-   }
+	if (rank != 0) {
+		return NULL;
+	}
 
-   /* no wrap of upper/lower boundary, since it is done by exchanged ghost zones */
+	name = name == NULL || *name == '\0' ? OBSERVE_DEFAULT_FILE : name;
+	file = fopen(name, "w");
+	if (file == NULL) {
+		perror(name);
+		MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+	}
+	fprintf(file, "# iteration\tlive\tchanged\n");
+
+	return file;
 }
 
-/* make one simulation iteration with lines lines.
- * old configuration is in from, new one is written to to.
- */
-static void simulate(line_t *from, line_t *to, int start_line, int lines)
+static void observe_write(FILE *file, int iteration, const struct ca_observables *obs)
 {
-	for (int y = start_line; y < start_line + lines; y++) {
-		for (int x = 1; x <= XSIZE; x++) {
-			to[y][x] = transition(from, x, y);
-		}
+	if (file != NULL) {
+		fprintf(file, "%d\t%llu\t%llu\n", iteration,
+			(unsigned long long)obs->live, (unsigned long long)obs->changed);
 	}
 }
 
-#ifdef _OPENMP
-static void simulate_omp(line_t *from, line_t *to, int start_line, int lines)
+/* Time of the halo exchange (from posting the last send to the completion
+ * observed by MPI_Testall or MPI_Waitall) and the part of it spent in
+ * MPI_Waitall, summed up over all processes. Without progress chunks the
+ * completion is only observed in MPI_Waitall, so everything up to the end of
+ * the computation counts as hidden. */
+static void comm_report(double comm_time, double exposed_time, int rank)
 {
-	#pragma omp parallel for
-	for (int y = start_line; y < start_line + lines; y++) {
-		for (int x = 1; x <= XSIZE; x++) {
-			to[y][x] = transition(from, x, y);
-		}
+	double local[2] = { comm_time, exposed_time }, sum[2], max[2];
+
+	MPI_Reduce(local, sum, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+	MPI_Reduce(local, max, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+	if (rank == 0) {
+		printf("halo exchange: %.3f s (max %.3f s), exposed %.3f s (max %.3f s), hidden %.1f %%\n",
+			sum[0], max[0], sum[1], max[1],
+			sum[0] > 0 ? 100.0 * (sum[0] - sum[1]) / sum[0] : 0.0);
 	}
-}	
-#endif
+}
 
 /* --------------------- measurement ---------------------------------- */
 
 int main(int argc, char** argv)
 {
 	int num_total_lines, num_local_lines, num_skip_lines, its;
-	int num_procs, local_rank;
+	int num_procs, num_ring_procs, local_rank;
 	line_t *from, *to, *temp;
+	const struct ca_kernel *kernel;
+	long rebalance_interval = ca_env_long("CA_REBALANCE", 0);
+	double compute_time = 0.0, local_lines_sum = 0.0;
+	int stop_stable = ca_env_long("CA_STOP_STABLE", 0) != 0;
+	int observe = stop_stable || ca_env_long("CA_OBSERVE", 0) != 0;
+	int its_done = 0, first_it = 0, cache_its, checkpoint_interval;
+	double sim_time, checkpoint_time = 0.0;
+	char *hash_str;
+	int progress_chunk = (int)ca_env_long("CA_PROGRESS_CHUNK", 0);
+	double comm_time = 0.0, exposed_time = 0.0;
+	/* observables of the last two iterations, the global ones of an
+	 * iteration are reduced in the background during the next one */
+	struct ca_observables obs_local[2], obs_global[2];
+	MPI_Request obs_req[2];
+	MPI_Comm observe_comm = MPI_COMM_NULL;
+	FILE *observe_file = NULL;
 
-	/* init MPI and application */
+	/* init MPI and application, in the hybrid version only the master thread
+	 * calls MPI (outside of parallel regions) */
+#ifdef _OPENMP
+	int thread_support;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
+#else
 	MPI_Init(&argc, &argv);
+#endif
 
 	MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
 	MPI_Comm_rank(MPI_COMM_WORLD, &local_rank);
 
 	ca_init(argc, argv, &num_total_lines, &its);
 
+	if (ca_cache_answer(num_total_lines, its)) {
+		MPI_Finalize();
+		return EXIT_SUCCESS;
+	}
+
 	ca_mpi_init(num_procs, local_rank, num_total_lines,
 		&num_local_lines, &num_skip_lines);
 
-	from = malloc((num_local_lines + 2) * sizeof(*from));
-	to = malloc((num_local_lines + 2) * sizeof(*to));
-
-	ca_init_config(from, num_local_lines, num_skip_lines);
-
-	/* initial exchange */
-	MPI_Sendrecv(
-			from[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			PREV_PROC(local_rank, num_procs), TAG_SEND_UPPER_BOUND,
-			from[num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			SUCC_PROC(local_rank, num_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD,
-			MPI_STATUS_IGNORE);
-	MPI_Sendrecv(
-			from[num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			SUCC_PROC(local_rank, num_procs), TAG_SEND_LOWER_BOUND,
-			from[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-			PREV_PROC(local_rank, num_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD,
-			MPI_STATUS_IGNORE);
+	kernel = ca_tune(num_total_lines, num_local_lines);
+
+	/* with less lines than processes, only the ones with lines form the ring */
+	num_ring_procs = num_procs < num_total_lines ? num_procs : num_total_lines;
+	if (num_ring_procs < num_procs) {
+		/* rebalancing needs all processes to take part */
+		rebalance_interval = 0;
+	}
+
+	from = ca_mem_alloc_config(num_local_lines);
+	to = ca_mem_alloc_config(num_local_lines);
+
+	/* the time series of the observables always starts with iteration 1, so
+	 * observing runs are not resumed from a cached configuration */
+	if (!observe) {
+		first_it = ca_cache_resume(num_total_lines, its, from, num_local_lines, num_skip_lines);
+	}
+	checkpoint_interval = observe ? 0 : ca_cache_checkpoint_interval();
+	if (first_it == 0) {
+		ca_init_config(from, num_local_lines, num_skip_lines);
+	}
+
+	/* initial exchange, idle processes skip the whole computation */
+	cache_its = its;
+	if (num_local_lines == 0) {
+		its = first_it;
+	} else {
+		MPI_Sendrecv(
+				from[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_SEND_UPPER_BOUND,
+				from[num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD,
+				MPI_STATUS_IGNORE);
+		MPI_Sendrecv(
+				from[num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				SUCC_PROC(local_rank, num_ring_procs), TAG_SEND_LOWER_BOUND,
+				from[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
+				PREV_PROC(local_rank, num_ring_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD,
+				MPI_STATUS_IGNORE);
+	}
+
+	/* the observables are reduced over the processes owning lines */
+	if (observe) {
+		MPI_Comm_split(MPI_COMM_WORLD, num_local_lines > 0 ? 0 : MPI_UNDEFINED,
+			local_rank, &observe_comm);
+		observe_file = observe_open(local_rank);
+	}
+
+	ca_mem_phase("init");
+	ca_perf_init();
 
 	/* actual computation */
+	ca_perf_start();
 	TIME_GET(sim_start);
-	for (int i = 0; i < its; i++) {
+	for (int i = first_it; i < its; i++) {
 		MPI_Request req[4];
-		boundary(from, num_local_lines);
+		struct timespec comm_stop;
+		int comm_done = 0, inner_lines, chunk;
+		TIME_GET(compute_start);
+
+		/* no wrap of upper/lower boundary, since it is done by exchanged ghost zones */
+		ca_boundary(from, num_local_lines);
 
 		/* prepost matching receive operation (prevent early sender/late receiver) */
 		MPI_Irecv(to[0], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-				PREV_PROC(local_rank, num_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD, &req[0]);
+				PREV_PROC(local_rank, num_ring_procs), TAG_RECV_UPPER_BOUND, MPI_COMM_WORLD, &req[0]);
 		MPI_Irecv(to[num_local_lines + 1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-				SUCC_PROC(local_rank, num_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD, &req[1]);
+				SUCC_PROC(local_rank, num_ring_procs), TAG_RECV_LOWER_BOUND, MPI_COMM_WORLD, &req[1]);
 
-		/* compute boundaries */
-		simulate(from, to, 1, 1);
-		simulate(from, to, num_local_lines, 1);
+		/* compute boundaries, lines are counted only once when observing */
+		if (observe) {
+			memset(&obs_local[i % 2], 0, sizeof(obs_local[i % 2]));
+			ca_simulate_observe(kernel, from, to, 1, 1, &obs_local[i % 2]);
+			if (num_local_lines > 1) {
+				ca_simulate_observe(kernel, from, to, num_local_lines, 1, &obs_local[i % 2]);
+			}
+		} else {
+			ca_simulate(kernel, from, to, 1, 1);
+			ca_simulate(kernel, from, to, num_local_lines, 1);
+		}
 
 		MPI_Isend(to[1], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-				PREV_PROC(local_rank, num_procs), TAG_SEND_UPPER_BOUND, MPI_COMM_WORLD, &req[2]);
+				PREV_PROC(local_rank, num_ring_procs), TAG_SEND_UPPER_BOUND, MPI_COMM_WORLD, &req[2]);
 		MPI_Isend(to[num_local_lines], LINE_SIZE, CA_MPI_CELL_DATATYPE,
-				SUCC_PROC(local_rank, num_procs), TAG_SEND_LOWER_BOUND, MPI_COMM_WORLD, &req[3]);
+				SUCC_PROC(local_rank, num_ring_procs), TAG_SEND_LOWER_BOUND, MPI_COMM_WORLD, &req[3]);
+		TIME_GET(comm_start);
+
+		/* simulate inner lines (the last one is counted already when observing),
+		 * test the requests between the chunks so the exchange makes progress */
+		inner_lines = observe ? num_local_lines - 2 : num_local_lines - 1;
+		chunk = progress_chunk > 0 ? progress_chunk : inner_lines;
+		for (int line = 2; line < 2 + inner_lines; line += chunk) {
+			int lines = 2 + inner_lines - line < chunk ? 2 + inner_lines - line : chunk;
+
+			if (observe) {
+				ca_simulate_observe_omp(kernel, from, to, line, lines, &obs_local[i % 2]);
+			} else {
+				ca_simulate_omp(kernel, from, to, line, lines);
+			}
+
+			if (progress_chunk > 0 && !comm_done) {
+				MPI_Testall(4, req, &comm_done, MPI_STATUSES_IGNORE);
+				if (comm_done) {
+					clock_gettime(CLOCK_MONOTONIC, &comm_stop);
+				}
+			}
+		}
 
-		/* simulate inner lines */
-		#ifdef _OPENMP
-		simulate_omp(from, to, 2, num_local_lines - 1);
-		#else
-		simulate(from, to, 2, num_local_lines - 1);
-		#endif
+		if (observe) {
+			MPI_Iallreduce(&obs_local[i % 2], &obs_global[i % 2], 2, MPI_UINT64_T,
+				MPI_SUM, observe_comm, &obs_req[i % 2]);
+		}
 
 		temp = from;
 		from = to;
 		to = temp;
 
-		MPI_Waitall(4, req, MPI_STATUS_IGNORE);
+		TIME_GET(compute_stop);
+		compute_time += TIME_DIFF(compute_start, compute_stop);
+		local_lines_sum += num_local_lines;
+
+		TIME_GET(wait_start);
+		MPI_Waitall(4, req, MPI_STATUSES_IGNORE);
+		TIME_GET(wait_stop);
+		if (!comm_done) {
+			comm_stop = wait_stop;
+		}
+		comm_time += TIME_DIFF(comm_start, comm_stop);
+		exposed_time += TIME_DIFF(wait_start, wait_stop);
+		its_done = i + 1;
+
+		/* storing checkpoints is neither part of the simulation time nor counted */
+		if (ca_cache_is_checkpoint(checkpoint_interval, i + 1, its)) {
+			ca_perf_pause();
+			TIME_GET(checkpoint_start);
+			ca_cache_checkpoint(num_total_lines, i + 1, from, num_local_lines, num_skip_lines);
+			TIME_GET(checkpoint_stop);
+			checkpoint_time += TIME_DIFF(checkpoint_start, checkpoint_stop);
+			ca_perf_resume();
+		}
+
+		/* observables of the previous iteration, all processes see the same
+		 * values and stop together. Once nothing changed, the configuration is
+		 * a fixed point and further iterations would not change it either. */
+		if (observe && i > 0) {
+			MPI_Wait(&obs_req[(i - 1) % 2], MPI_STATUS_IGNORE);
+			observe_write(observe_file, i, &obs_global[(i - 1) % 2]);
+			if (stop_stable && obs_global[(i - 1) % 2].changed == 0) {
+				break;
+			}
+		}
+
+		/* move lines from slow to fast processes, the ghost zones are exchanged again */
+		if (rebalance_interval > 0 && (i + 1) % rebalance_interval == 0 && i + 1 < its) {
+			ca_mpi_rebalance(&from, &to, &num_local_lines, &num_skip_lines,
+				compute_time, num_ring_procs);
+			compute_time = 0.0;
+		}
 	}
 	TIME_GET(sim_stop);
+	ca_perf_stop();
+	ca_mem_phase("compute");
 
+	sim_time = TIME_DIFF(sim_start, sim_stop) - checkpoint_time;
 
-	ca_mpi_hash_and_report(from, num_local_lines, num_total_lines,
-		num_procs, TIME_DIFF(sim_start, sim_stop));
+	/* idle processes take part in storing the checkpoints */
+	for (int i = its; i < cache_its; i++) {
+		if (ca_cache_is_checkpoint(checkpoint_interval, i + 1, cache_its)) {
+			ca_cache_checkpoint(num_total_lines, i + 1, from, 0, num_skip_lines);
+		}
+	}
+
+	if (observe && its_done > 0) {
+		MPI_Wait(&obs_req[(its_done - 1) % 2], MPI_STATUS_IGNORE);
+		observe_write(observe_file, its_done, &obs_global[(its_done - 1) % 2]);
+		if (observe_file != NULL && its_done < its) {
+			fprintf(stderr, "configuration stable, stopped after %d of %d iterations\n",
+				its_done, its);
+		}
+	}
+	if (observe_file != NULL) {
+		fclose(observe_file);
+	}
+	if (observe_comm != MPI_COMM_NULL) {
+		MPI_Comm_free(&observe_comm);
+	}
+
+
+	hash_str = ca_mpi_hash_str(from, num_local_lines, MPI_COMM_WORLD);
+	if (hash_str != NULL) {
+		ca_print_hash_and_time(hash_str, sim_time);
+		ca_cache_store_hash(num_total_lines, cache_its, hash_str);
+		free(hash_str);
+	}
+	ca_mem_phase("hash");
+	if (ca_env_long("CA_COMM_REPORT", 0)) {
+		comm_report(comm_time, exposed_time, local_rank);
+	}
+	ca_mem_report();
+	ca_perf_report(local_lines_sum * XSIZE, sim_time);
+	ca_perf_finalize();
 
-	free(from);
-	free(to);
+	ca_mem_free(from);
+	ca_mem_free(to);
 
 	MPI_Finalize();
 
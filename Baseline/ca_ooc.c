@@ -0,0 +1,173 @@
+/*
+ * simulate a cellular automaton with periodic boundaries (torus-like)
+ * sequential out-of-core version for configurations exceeding the memory
+ *
+ * The configuration lives in a file on local disk, a second file receives the
+ * next one (ping-pong). A pass streams bands of CA_OOC_BAND lines through
+ * memory and applies CA_OOC_STEPS time steps to each band at once. For that,
+ * a band is read with CA_OOC_STEPS extra lines on both sides and every time
+ * step computes two lines less (trapezoid), so only the band itself is valid
+ * and written after the last step. The memory needed is independent of the
+ * number of lines, and every cell is read and written once per CA_OOC_STEPS
+ * time steps instead of once per time step.
+ *
+ * command line arguments:
+ * #1: Number of lines
+ * #2: Number of iterations to be simulated
+ *
+ * environment variables:
+ * CA_PRINT_HASH=1: print the MD5 hash of the final configuration after the time
+ * CA_KERNEL: compute kernel (see ca_kernels.c), default: simulate
+ * CA_OOC_DIR: directory of the configuration files, default: current directory
+ * CA_OOC_BAND=n: lines per band, default: 4096
+ * CA_OOC_STEPS=n: time steps per pass, default: 16
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ca_common.h"
+#include "ca_kernels.h"
+
+/* configuration file in dir, removed when closed */
+static int open_config_file(const char *dir)
+{
+	char path[4096];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/ca_ooc.XXXXXX", dir);
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	unlink(path);
+
+	return fd;
+}
+
+/* read or write the lines [first, first + lines) of a configuration file */
+static void transfer(int fd, line_t *buf, long first, long lines, int write)
+{
+	char *ptr = (char *)buf;
+	size_t size = lines * sizeof(*buf);
+	off_t offset = first * (off_t)sizeof(*buf);
+
+	while (size > 0) {
+		ssize_t done = write ? pwrite(fd, ptr, size, offset) : pread(fd, ptr, size, offset);
+
+		if (done <= 0) {
+			perror("ca_ooc");
+			exit(EXIT_FAILURE);
+		}
+		ptr += done;
+		size -= done;
+		offset += done;
+	}
+}
+
+/* read lines lines starting at first, wrapping around the torus as often as
+ * needed (for bands larger than the configuration) */
+static void read_torus(int fd, line_t *buf, long first, long lines, long num_total_lines)
+{
+	first = (first % num_total_lines + num_total_lines) % num_total_lines;
+
+	while (lines > 0) {
+		long chunk = lines < num_total_lines - first ? lines : num_total_lines - first;
+
+		transfer(fd, buf, first, chunk, 0);
+		buf += chunk;
+		lines -= chunk;
+		first = 0;
+	}
+}
+
+/* --------------------- measurement ---------------------------------- */
+
+int main(int argc, char** argv)
+{
+	int lines, its, band, max_steps, from_fd, to_fd, temp_fd;
+	const char *dir = getenv("CA_OOC_DIR");
+	const struct ca_kernel *kernel = ca_kernel_default();
+	line_t *win_from, *win_to;
+	struct ca_hash *hash;
+	char *hash_str;
+
+	ca_init(argc, argv, &lines, &its);
+
+	band = (int)ca_env_long("CA_OOC_BAND", 4096);
+	max_steps = (int)ca_env_long("CA_OOC_STEPS", 16);
+	band = band < 1 ? 1 : band;
+	max_steps = max_steps < 1 ? 1 : max_steps;
+	dir = dir == NULL || *dir == '\0' ? "." : dir;
+
+	from_fd = open_config_file(dir);
+	to_fd = open_config_file(dir);
+
+	/* a band with its trapezoid lines and the ghost lines of the window */
+	win_from = calloc(band + 2 * max_steps + 2, sizeof(*win_from));
+	win_to = calloc(band + 2 * max_steps + 2, sizeof(*win_to));
+
+	/* the same configuration as ca_seq, written band by band */
+	for (long first = 0; first < lines; first += band) {
+		int band_lines = first + band > lines ? lines - first : band;
+
+		if (first == 0) {
+			ca_init_config(win_from, band_lines, 0);
+		} else {
+			ca_init_config_next(win_from, band_lines);
+		}
+		transfer(from_fd, win_from + 1, first, band_lines, 1);
+	}
+
+	/* actual computation */
+	TIME_GET(sim_start);
+	for (int i = 0; i < its; ) {
+		int steps = its - i < max_steps ? its - i : max_steps;
+
+		for (long first = 0; first < lines; first += band) {
+			int band_lines = first + band > lines ? lines - first : band;
+			int window_lines = band_lines + 2 * steps;
+			line_t *from = win_from, *to = win_to, *temp;
+
+			read_torus(from_fd, from + 1, first - steps, window_lines, lines);
+
+			/* lines [1 + s, window_lines - s] are valid after time step s */
+			for (int s = 1; s <= steps; s++) {
+				ca_boundary(from, window_lines);
+				ca_simulate(kernel, from, to, 1 + s, window_lines - 2 * s);
+
+				temp = from;
+				from = to;
+				to = temp;
+			}
+
+			transfer(to_fd, from + 1 + steps, first, band_lines, 1);
+		}
+
+		temp_fd = from_fd;
+		from_fd = to_fd;
+		to_fd = temp_fd;
+		i += steps;
+	}
+	TIME_GET(sim_stop);
+
+	hash = ca_hash_begin();
+	for (long first = 0; first < lines; first += band) {
+		int band_lines = first + band > lines ? lines - first : band;
+
+		transfer(from_fd, win_from + 1, first, band_lines, 0);
+		ca_hash_update(hash, win_from + 1, band_lines);
+	}
+	hash_str = ca_hash_end(hash);
+	ca_print_hash_and_time(hash_str, TIME_DIFF(sim_start, sim_stop));
+
+	free(hash_str);
+	free(win_from);
+	free(win_to);
+	close(from_fd);
+	close(to_fd);
+
+	return EXIT_SUCCESS;
+}
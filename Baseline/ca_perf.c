@@ -0,0 +1,376 @@
+/*
+ * hardware performance counters for the compute phase (Linux perf_event)
+ *
+ * every thread gets its own set of counters (pid = 0, cpu = -1), so the
+ * values are attributed to the thread which opened them. With OpenMP the
+ * counters are opened inside a parallel region, relying on the runtime to
+ * reuse its thread pool for subsequent parallel regions.
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ca_common.h"
+#include "ca_perf.h"
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+/* bytes transferred from memory per last level cache miss */
+#define CA_PERF_LINE_BYTES 64
+
+enum ca_perf_event {
+	CA_PERF_CYCLES,
+	CA_PERF_INSTRUCTIONS,
+	CA_PERF_LLC_LOAD_MISSES,
+	CA_PERF_LLC_STORE_MISSES,
+	CA_PERF_NUM_EVENTS
+};
+
+static const char *ca_perf_event_names[CA_PERF_NUM_EVENTS] = {
+	"cycles", "instructions", "llc-load-misses", "llc-store-misses"
+};
+
+static int perf_enabled;
+static int perf_num_threads;
+/* file descriptor per thread and event, -1 if the event is not available */
+static int (*perf_fds)[CA_PERF_NUM_EVENTS];
+
+#ifdef __linux__
+
+static int ca_perf_open(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void ca_perf_open_thread(int thread)
+{
+	const uint64_t llc = PERF_COUNT_HW_CACHE_LL;
+
+	perf_fds[thread][CA_PERF_CYCLES] =
+		ca_perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	perf_fds[thread][CA_PERF_INSTRUCTIONS] =
+		ca_perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	perf_fds[thread][CA_PERF_LLC_LOAD_MISSES] =
+		ca_perf_open(PERF_TYPE_HW_CACHE, llc | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+	perf_fds[thread][CA_PERF_LLC_STORE_MISSES] =
+		ca_perf_open(PERF_TYPE_HW_CACHE, llc | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+}
+
+static void ca_perf_ioctl(unsigned long request)
+{
+	for (int t = 0; t < perf_num_threads; t++) {
+		for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+			if (perf_fds[t][e] >= 0) {
+				ioctl(perf_fds[t][e], request, 0);
+			}
+		}
+	}
+}
+
+/* counter value scaled for multiplexing, -1 if not available */
+static double ca_perf_read(int fd)
+{
+	uint64_t data[3];
+
+	if (fd < 0 || read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) {
+		return -1.0;
+	}
+
+	return (double)data[0] * ((double)data[1] / data[2]);
+}
+
+#endif /* __linux__ */
+
+int ca_perf_init(void)
+{
+	int num_open = 0;
+
+	perf_enabled = ca_env_long("CA_PERF", 0) != 0;
+	if (!perf_enabled) {
+		return 0;
+	}
+
+#ifdef _OPENMP
+	perf_num_threads = omp_get_max_threads();
+#else
+	perf_num_threads = 1;
+#endif
+	perf_fds = malloc(perf_num_threads * sizeof(*perf_fds));
+	for (int t = 0; t < perf_num_threads; t++) {
+		for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+			perf_fds[t][e] = -1;
+		}
+	}
+
+#ifdef __linux__
+	#ifdef _OPENMP
+	#pragma omp parallel num_threads(perf_num_threads)
+	ca_perf_open_thread(omp_get_thread_num());
+	#else
+	ca_perf_open_thread(0);
+	#endif
+#endif
+
+	for (int t = 0; t < perf_num_threads; t++) {
+		for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+			num_open += perf_fds[t][e] >= 0;
+		}
+	}
+
+	if (num_open == 0) {
+		fprintf(stderr, "perf: no hardware counters available "
+			"(check /proc/sys/kernel/perf_event_paranoid)\n");
+	}
+
+	return num_open > 0;
+}
+
+void ca_perf_start(void)
+{
+#ifdef __linux__
+	if (perf_enabled) {
+		ca_perf_ioctl(PERF_EVENT_IOC_RESET);
+		ca_perf_ioctl(PERF_EVENT_IOC_ENABLE);
+	}
+#endif
+}
+
+void ca_perf_stop(void)
+{
+#ifdef __linux__
+	if (perf_enabled) {
+		ca_perf_ioctl(PERF_EVENT_IOC_DISABLE);
+	}
+#endif
+}
+
+void ca_perf_pause(void)
+{
+	ca_perf_stop();
+}
+
+void ca_perf_resume(void)
+{
+#ifdef __linux__
+	if (perf_enabled) {
+		ca_perf_ioctl(PERF_EVENT_IOC_ENABLE);
+	}
+#endif
+}
+
+/* sum of an event over threads, -1 if it was not available on any thread */
+static double ca_perf_sum(const double *values, int num_threads, int event)
+{
+	double sum = -1.0;
+
+	for (int t = 0; t < num_threads; t++) {
+		double v = values[t * CA_PERF_NUM_EVENTS + event];
+		if (v >= 0) {
+			sum = (sum < 0 ? 0 : sum) + v;
+		}
+	}
+
+	return sum;
+}
+
+static void ca_perf_print_value(const char *name, double value)
+{
+	if (value < 0) {
+		printf(" %s n/a", name);
+	} else {
+		printf(" %s %.4g", name, value);
+	}
+}
+
+static void ca_perf_print_counts(const double *values)
+{
+	for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+		ca_perf_print_value(ca_perf_event_names[e], values[e]);
+	}
+	if (values[CA_PERF_CYCLES] > 0 && values[CA_PERF_INSTRUCTIONS] >= 0) {
+		printf(" ipc %.2f", values[CA_PERF_INSTRUCTIONS] / values[CA_PERF_CYCLES]);
+	}
+}
+
+/* derived metrics for a set of summed counters */
+static void ca_perf_print_derived(const double *sum, double cell_updates,
+		double time_in_s, double stream_gbs)
+{
+	double misses = -1.0, bytes;
+
+	if (sum[CA_PERF_LLC_LOAD_MISSES] >= 0 || sum[CA_PERF_LLC_STORE_MISSES] >= 0) {
+		misses = (sum[CA_PERF_LLC_LOAD_MISSES] > 0 ? sum[CA_PERF_LLC_LOAD_MISSES] : 0) +
+			(sum[CA_PERF_LLC_STORE_MISSES] > 0 ? sum[CA_PERF_LLC_STORE_MISSES] : 0);
+	}
+
+	ca_perf_print_value("cells/cycle",
+		sum[CA_PERF_CYCLES] > 0 ? cell_updates / sum[CA_PERF_CYCLES] : -1.0);
+	if (misses < 0) {
+		printf(" bytes/cell n/a bandwidth n/a");
+		return;
+	}
+
+	bytes = misses * CA_PERF_LINE_BYTES;
+	printf(" bytes/cell %.3f bandwidth %.3f GB/s",
+		cell_updates > 0 ? bytes / cell_updates : 0.0,
+		time_in_s > 0 ? bytes / time_in_s / 1.0E+9 : 0.0);
+	if (stream_gbs > 0 && time_in_s > 0) {
+		printf(" (%.1f%% of STREAM %.2f GB/s)",
+			100.0 * bytes / time_in_s / 1.0E+9 / stream_gbs, stream_gbs);
+	}
+}
+
+/* print all threads of one rank, values holds num_threads * CA_PERF_NUM_EVENTS */
+static void ca_perf_print_rank(int rank, int num_threads, const double *values,
+		double cell_updates, double time_in_s, double stream_gbs)
+{
+	double sum[CA_PERF_NUM_EVENTS];
+
+	for (int t = 0; t < num_threads; t++) {
+		printf("perf rank %d thread %d:", rank, t);
+		ca_perf_print_counts(values + t * CA_PERF_NUM_EVENTS);
+		printf("\n");
+	}
+
+	for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+		sum[e] = ca_perf_sum(values, num_threads, e);
+	}
+	printf("perf rank %d:", rank);
+	ca_perf_print_derived(sum, cell_updates, time_in_s, stream_gbs);
+	printf("\n");
+}
+
+void ca_perf_report(double cell_updates, double time_in_s)
+{
+	double stream_gbs;
+	/* header: number of threads, cell updates, time */
+	int num_values = 3 + perf_num_threads * CA_PERF_NUM_EVENTS;
+	double *local;
+
+	if (!perf_enabled) {
+		return;
+	}
+
+	stream_gbs = ca_env_double("CA_STREAM_GBS", 0.0);
+
+	local = malloc(num_values * sizeof(*local));
+	local[0] = perf_num_threads;
+	local[1] = cell_updates;
+	local[2] = time_in_s;
+	for (int t = 0; t < perf_num_threads; t++) {
+		for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+#ifdef __linux__
+			local[3 + t * CA_PERF_NUM_EVENTS + e] = ca_perf_read(perf_fds[t][e]);
+#else
+			local[3 + t * CA_PERF_NUM_EVENTS + e] = -1.0;
+#endif
+		}
+	}
+
+#ifdef MPI_VERSION
+	int rank, num_procs, *counts = NULL, *displs = NULL;
+	double *all = NULL;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+
+	if (rank == 0) {
+		counts = malloc(num_procs * sizeof(*counts));
+		displs = malloc(num_procs * sizeof(*displs));
+	}
+	MPI_Gather(&num_values, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+	if (rank == 0) {
+		displs[0] = 0;
+		for (int i = 1; i < num_procs; i++) {
+			displs[i] = displs[i - 1] + counts[i - 1];
+		}
+		all = malloc((displs[num_procs - 1] + counts[num_procs - 1]) * sizeof(*all));
+	}
+	MPI_Gatherv(local, num_values, MPI_DOUBLE,
+		all, counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+	if (rank == 0) {
+		double total[CA_PERF_NUM_EVENTS], total_cells = 0.0, max_time = 0.0;
+
+		for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+			total[e] = -1.0;
+		}
+
+		for (int i = 0; i < num_procs; i++) {
+			const double *r = all + displs[i];
+			int num_threads = (int)r[0];
+
+			ca_perf_print_rank(i, num_threads, r + 3, r[1], r[2], stream_gbs);
+
+			total_cells += r[1];
+			max_time = r[2] > max_time ? r[2] : max_time;
+			for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+				double s = ca_perf_sum(r + 3, num_threads, e);
+				if (s >= 0) {
+					total[e] = (total[e] < 0 ? 0 : total[e]) + s;
+				}
+			}
+		}
+
+		/* CA_STREAM_GBS refers to a single node, so it is not applied to the total */
+		printf("perf total:");
+		ca_perf_print_derived(total, total_cells, max_time, 0.0);
+		printf("\n");
+
+		free(all);
+		free(displs);
+		free(counts);
+	}
+#else
+	ca_perf_print_rank(0, perf_num_threads, local + 3, cell_updates, time_in_s, stream_gbs);
+#endif
+
+	free(local);
+}
+
+void ca_perf_finalize(void)
+{
+#ifdef __linux__
+	if (perf_enabled) {
+		for (int t = 0; t < perf_num_threads; t++) {
+			for (int e = 0; e < CA_PERF_NUM_EVENTS; e++) {
+				if (perf_fds[t][e] >= 0) {
+					close(perf_fds[t][e]);
+				}
+			}
+		}
+	}
+#endif
+	free(perf_fds);
+	perf_fds = NULL;
+	perf_enabled = 0;
+}
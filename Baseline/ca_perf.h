@@ -0,0 +1,44 @@
+#ifndef CA_PERF_H
+#define CA_PERF_H
+
+/*
+ * optional hardware performance counters (Linux perf_event) for the
+ * compute phase of the cellular automaton
+ *
+ * counting is enabled by setting the environment variable CA_PERF=1.
+ * CA_STREAM_GBS may be set to the bandwidth measured by a STREAM-like
+ * benchmark (e.g. ca_bench) to relate the achieved memory bandwidth to it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* opens the counters for the calling thread or, if compiled with OpenMP,
+ * for every thread of the OpenMP thread pool. Must be called outside of
+ * parallel regions before ca_perf_start. Returns non-zero if counting is
+ * active. */
+int ca_perf_init(void);
+
+/* start/stop counting on all opened counters (callable from one thread) */
+void ca_perf_start(void);
+void ca_perf_stop(void);
+
+/* exclude work between ca_perf_pause and ca_perf_resume from the counts
+ * since ca_perf_start (e.g. checkpoint I/O) */
+void ca_perf_pause(void);
+void ca_perf_resume(void);
+
+/* print counter values and derived metrics per thread and per rank. In
+ * MPI builds this is collective and rank 0 prints for all ranks.
+ * cell_updates is the number of cell updates done by the calling rank. */
+void ca_perf_report(double cell_updates, double time_in_s);
+
+/* close all counters */
+void ca_perf_finalize(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CA_PERF_H */
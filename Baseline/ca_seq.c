@@ -0,0 +1,113 @@
+/*
+ * simulate a cellular automaton with periodic boundaries (torus-like)
+ * sequential reference version without MPI
+ *
+ * (c) 2016 Steffen Christgau (C99 port, modularization, parallelization)
+ * (c) 1996,1997 Peter Sanders, Ingo Boesnach (original source)
+ *
+ * command line arguments:
+ * #1: Number of lines
+ * #2: Number of iterations to be simulated
+ *
+ * environment variables:
+ * CA_PRINT_HASH=1: print the MD5 hash of the final configuration after the time
+ * CA_KERNEL: compute kernel (see ca_kernels.c), default: simulate or the
+ *            tuned kernel (see ca_tune.h)
+ * CA_TUNE=1: probe kernels and OpenMP threads, store the fastest in CA_TUNE_FILE
+ * CA_CACHE_DIR: directory of the result cache (see ca_cache.h), default: none
+ * CA_CACHE_CHECKPOINT=n: cache the configuration every n iterations
+ * CA_CACHE_ANSWER=1: print the cached hash (labeled "cached", without time)
+ *                   instead of simulating
+ * CA_MEMPROF=1: report the memory usage after initialization, computation and
+ *               hashing (see ca_mem.h)
+ * CA_PERF=1: report hardware performance counters of the compute phase
+ * CA_STREAM_GBS: STREAM bandwidth of a node (GB/s) to relate CA_PERF results to
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ca_cache.h"
+#include "ca_common.h"
+#include "ca_kernels.h"
+#include "ca_mem.h"
+#include "ca_perf.h"
+#include "ca_tune.h"
+
+/* treat torus like boundary conditions for lines and columns */
+static void boundary(line_t *buf, int lines)
+{
+	/* copy last line to the upper ghost line and first line to the lower one */
+	memcpy(buf[0], buf[lines], sizeof(*buf));
+	memcpy(buf[lines + 1], buf[1], sizeof(*buf));
+
+	ca_boundary(buf, lines);
+}
+
+/* --------------------- measurement ---------------------------------- */
+
+int main(int argc, char** argv)
+{
+	int lines, its, first_it, checkpoint_interval = ca_cache_checkpoint_interval();
+	double sim_time, checkpoint_time = 0.0;
+	char *hash_str;
+
+	ca_init(argc, argv, &lines, &its);
+
+	if (ca_cache_answer(lines, its)) {
+		return EXIT_SUCCESS;
+	}
+
+	line_t *from = ca_mem_alloc_config(lines);
+	line_t *to = ca_mem_alloc_config(lines);
+	const struct ca_kernel *kernel = ca_tune(lines, lines);
+
+	first_it = ca_cache_resume(lines, its, from, lines, 0);
+	if (first_it == 0) {
+		ca_init_config(from, lines, 0);
+	}
+
+	ca_mem_phase("init");
+	ca_perf_init();
+
+	/* actual computation */
+	ca_perf_start();
+	TIME_GET(sim_start);
+	for (int i = first_it; i < its; i++) {
+		boundary(from, lines);
+		ca_simulate(kernel, from, to, 1, lines);
+
+		line_t *temp = from;
+		from = to;
+		to = temp;
+
+		/* storing checkpoints is neither part of the simulation time nor counted */
+		if (ca_cache_is_checkpoint(checkpoint_interval, i + 1, its)) {
+			ca_perf_pause();
+			TIME_GET(checkpoint_start);
+			ca_cache_checkpoint(lines, i + 1, from, lines, 0);
+			TIME_GET(checkpoint_stop);
+			checkpoint_time += TIME_DIFF(checkpoint_start, checkpoint_stop);
+			ca_perf_resume();
+		}
+	}
+	TIME_GET(sim_stop);
+	ca_perf_stop();
+	sim_time = TIME_DIFF(sim_start, sim_stop) - checkpoint_time;
+	ca_mem_phase("compute");
+
+	hash_str = ca_hash_str(from + 1, lines);
+	ca_print_hash_and_time(hash_str, sim_time);
+	ca_cache_store_hash(lines, its, hash_str);
+	free(hash_str);
+	ca_mem_phase("hash");
+	ca_mem_report();
+	ca_perf_report((double)lines * XSIZE * (its - first_it), sim_time);
+	ca_perf_finalize();
+
+	ca_mem_free(from);
+	ca_mem_free(to);
+
+	return EXIT_SUCCESS;
+}
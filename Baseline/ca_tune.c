@@ -0,0 +1,285 @@
+/*
+ * auto-tuning of kernel and OpenMP threads per process
+ *
+ * Every candidate simulates the local number of lines without communication
+ * for at least TUNE_PROBE_TIME seconds. In MPI builds all processes probe at
+ * the same time, so shared caches and memory bandwidth of a node are
+ * contended like in the actual run, and the slowest process rates the
+ * candidate. The cache is a text file with one entry per line:
+ *
+ * <host> TAB <cpu model> TAB <lines> TAB <procs> TAB <max threads> TAB <kernel> TAB <threads>
+ *
+ * where later entries override earlier ones with the same key. The host is
+ * the one of rank 0.
+ *
+ * Only the kernel and the number of threads are tuned. Knobs of single
+ * drivers (e.g. CA_PROGRESS_CHUNK, CA_DF_BLOCK) are left to the user.
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "ca_common.h"
+#include "ca_kernels.h"
+#include "ca_tune.h"
+
+/* minimum run time of a single probe */
+#define TUNE_PROBE_TIME (0.05)
+
+#define TUNE_DEFAULT_FILE "ca_tune.cache"
+
+#define TUNE_MODEL_SIZE (128)
+#define TUNE_HOST_SIZE (64)
+
+/* key of a cache entry */
+struct tune_key {
+	char host[TUNE_HOST_SIZE];
+	char cpu_model[TUNE_MODEL_SIZE];
+	int lines;
+	int procs;
+	int max_threads;
+};
+
+static void tune_cpu_model(char *model)
+{
+	char line[256];
+	FILE *cpuinfo = fopen("/proc/cpuinfo", "r");
+
+	strcpy(model, "unknown");
+	if (cpuinfo == NULL) {
+		return;
+	}
+
+	while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+		char *value = strchr(line, ':');
+
+		if (strncmp(line, "model name", 10) == 0 && value != NULL) {
+			value += strspn(value, ": \t");
+			value[strcspn(value, "\t\n")] = '\0';
+			snprintf(model, TUNE_MODEL_SIZE, "%s", value);
+			break;
+		}
+	}
+
+	fclose(cpuinfo);
+}
+
+static const char *tune_file(void)
+{
+	const char *file = getenv("CA_TUNE_FILE");
+
+	return file == NULL || *file == '\0' ? TUNE_DEFAULT_FILE : file;
+}
+
+/* last matching entry of the cache, returns non-zero if found */
+static int tune_load(const struct tune_key *key, int *kernel_index, int *num_threads)
+{
+	char line[TUNE_HOST_SIZE + TUNE_MODEL_SIZE + 128], kernel_name[64];
+	int found = 0;
+	FILE *cache = fopen(tune_file(), "r");
+
+	if (cache == NULL) {
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), cache) != NULL) {
+		char *model = strchr(line, '\t'), *fields;
+		int lines, procs, max_threads, threads;
+		const struct ca_kernel *kernel;
+
+		if (model == NULL) {
+			continue;
+		}
+		*model++ = '\0';
+		fields = strchr(model, '\t');
+		if (fields == NULL) {
+			continue;
+		}
+		*fields++ = '\0';
+
+		if (strcmp(line, key->host) != 0 || strcmp(model, key->cpu_model) != 0
+				|| sscanf(fields, "%d\t%d\t%d\t%63s\t%d", &lines, &procs,
+					&max_threads, kernel_name, &threads) != 5
+				|| lines != key->lines || procs != key->procs
+				|| max_threads != key->max_threads) {
+			continue;
+		}
+
+		kernel = ca_kernel_find(kernel_name);
+		if (kernel != NULL) {
+			*kernel_index = (int)(kernel - ca_kernels);
+			*num_threads = threads;
+			found = 1;
+		}
+	}
+
+	fclose(cache);
+
+	return found;
+}
+
+static void tune_store(const struct tune_key *key, int kernel_index, int num_threads)
+{
+	FILE *cache = fopen(tune_file(), "a");
+
+	if (cache == NULL) {
+		perror(tune_file());
+		return;
+	}
+
+	fprintf(cache, "%s\t%s\t%d\t%d\t%d\t%s\t%d\n", key->host, key->cpu_model,
+		key->lines, key->procs, key->max_threads, ca_kernels[kernel_index].name,
+		num_threads);
+	fclose(cache);
+}
+
+/* seconds per iteration of a kernel on the lines of from */
+static double tune_probe(const struct ca_kernel *kernel, line_t *from, line_t *to, int lines)
+{
+	double time;
+	long its = 1;
+
+	if (lines == 0) {
+		return 0.0;
+	}
+
+	/* double the iterations until the probe runs long enough */
+	for (;;) {
+		TIME_GET(probe_start);
+		for (long i = 0; i < its; i++) {
+			ca_simulate_omp(kernel, from, to, 1, lines);
+
+			line_t *temp = from;
+			from = to;
+			to = temp;
+		}
+		TIME_GET(probe_stop);
+
+		time = TIME_DIFF(probe_start, probe_stop);
+		if (time >= TUNE_PROBE_TIME) {
+			return time / its;
+		}
+		its *= 2;
+	}
+}
+
+/* fastest combination of kernel and thread count, the same on all processes */
+static void tune_run(int num_local_lines, int max_threads, int *kernel_index, int *num_threads)
+{
+	double best_time = -1.0;
+	line_t *from = calloc(num_local_lines + 2, sizeof(*from));
+	line_t *to = calloc(num_local_lines + 2, sizeof(*to));
+	cell_state_t *cells = (cell_state_t *)from;
+	uint64_t state = 88172645463325252ULL;
+
+	/* the kernels do not depend on the states, any configuration of zeros and
+	 * ones will do. This includes the ghost cells of both buffers, the ones of
+	 * to are never written and stay zero. */
+	for (size_t i = 0; i < (num_local_lines + 2) * sizeof(*from); i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		cells[i] = state & 1;
+	}
+
+	for (int k = 0; k < ca_num_kernels; k++) {
+		/* 1, 2, 4, ... threads and the maximum */
+		for (int threads = 1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+			double time;
+
+#ifdef _OPENMP
+			omp_set_num_threads(threads);
+#endif
+#ifdef MPI_VERSION
+			MPI_Barrier(MPI_COMM_WORLD);
+#endif
+			time = tune_probe(&ca_kernels[k], from, to, num_local_lines);
+#ifdef MPI_VERSION
+			MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+			if (best_time < 0.0 || time < best_time) {
+				best_time = time;
+				*kernel_index = k;
+				*num_threads = threads;
+			}
+
+			if (threads == max_threads) {
+				break;
+			}
+		}
+	}
+
+	free(from);
+	free(to);
+}
+
+const struct ca_kernel *ca_tune(int num_total_lines, int num_local_lines)
+{
+	const char *kernel_name = getenv("CA_KERNEL");
+	const char *omp_threads = getenv("OMP_NUM_THREADS");
+	struct tune_key key;
+	int rank = 0, config[2] = { -1, 0 };
+
+	if (kernel_name != NULL && *kernel_name != '\0') {
+		return ca_kernel_default();
+	}
+
+	memset(&key, 0, sizeof(key));
+	tune_cpu_model(key.cpu_model);
+	if (gethostname(key.host, sizeof(key.host) - 1) != 0) {
+		strcpy(key.host, "unknown");
+	}
+	key.lines = num_total_lines;
+	key.procs = 1;
+	key.max_threads = 1;
+#ifdef MPI_VERSION
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &key.procs);
+#endif
+#ifdef _OPENMP
+	key.max_threads = omp_get_max_threads();
+#endif
+
+	if (ca_env_long("CA_TUNE", 0)) {
+		tune_run(num_local_lines, key.max_threads, &config[0], &config[1]);
+		if (rank == 0) {
+			tune_store(&key, config[0], config[1]);
+			fprintf(stderr, "tuned: kernel %s, %d threads\n",
+				ca_kernels[config[0]].name, config[1]);
+		}
+	} else {
+		/* a cached thread count must not override an explicit OMP_NUM_THREADS */
+		if (rank == 0 && (omp_threads == NULL || *omp_threads == '\0')) {
+			if (tune_load(&key, &config[0], &config[1])) {
+				fprintf(stderr, "tuned (%s): kernel %s, %d threads\n", tune_file(),
+					ca_kernels[config[0]].name, config[1]);
+			} else {
+				config[0] = -1;
+			}
+		}
+#ifdef MPI_VERSION
+		MPI_Bcast(config, 2, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+	}
+
+	if (config[0] < 0) {
+		return ca_kernel_default();
+	}
+
+#ifdef _OPENMP
+	omp_set_num_threads(config[1]);
+#endif
+
+	return &ca_kernels[config[0]];
+}
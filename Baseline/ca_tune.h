@@ -0,0 +1,31 @@
+#ifndef CA_TUNE_H
+#define CA_TUNE_H
+
+/*
+ * selection of the compute kernel and the number of OpenMP threads per
+ * process by short probes, cached per CPU model and problem size
+ *
+ * CA_TUNE=1 runs the probes and stores the fastest configuration in the
+ * tuning cache (CA_TUNE_FILE, default: ca_tune.cache). Without CA_TUNE, a
+ * matching cache entry is used unless OMP_NUM_THREADS is set. An explicitly
+ * set CA_KERNEL always wins. Only the kernel and the number of threads are
+ * tuned.
+ */
+
+#include "ca_kernels.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* kernel for num_local_lines lines per process of a configuration with
+ * num_total_lines lines. If the configuration comes from the probes or the
+ * cache, the number of OpenMP threads of the calling process is set as
+ * well. Collective in MPI builds. */
+const struct ca_kernel *ca_tune(int num_total_lines, int num_local_lines);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CA_TUNE_H */
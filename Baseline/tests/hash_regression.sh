@@ -0,0 +1,147 @@
+#!/bin/bash
+# hash-equivalence regression test for all drivers
+#
+# runs ca_seq, ca_ooc, the MPI drivers and the ensemble driver over a matrix of
+# lines, iterations, process counts, OpenMP thread counts and kernels and
+# compares the MD5 of every run with the golden hashes in golden_hashes.txt
+# (format: <lines> <iterations> <hash>). The matrix includes fewer lines
+# than processes and exactly one line per process.
+#
+# The default matrix is small enough for make check, FULL=1 sweeps more
+# lines, iterations, process counts and all kernels (several thousand runs).
+#
+# usage: tests/hash_regression.sh [--update]
+#   --update: regenerate golden_hashes.txt with ca_seq and the reference kernel
+#             for the lines and iterations of the full matrix
+#
+# environment variables overriding the defaults:
+#   FULL=1      full matrix
+#   MPIEXEC     MPI launcher incl. options (default: mpiexec)
+#   LINES, ITERATIONS, PROCS, THREADS, KERNELS: space separated test matrix
+#
+# More processes than cores need MPIEXEC="mpiexec --oversubscribe" with Open
+# MPI, running as root additionally OMPI_ALLOW_RUN_AS_ROOT=1 and
+# OMPI_ALLOW_RUN_AS_ROOT_CONFIRM=1.
+
+cd "$(dirname "$0")/.." || exit 1
+
+GOLDEN=tests/golden_hashes.txt
+
+if [ "$1" == "--update" ]; then
+	FULL=1
+fi
+
+MPIEXEC=${MPIEXEC:-mpiexec}
+if [ "${FULL:-0}" != "0" ]; then
+	LINES=${LINES:-"1 3 5 8 33 100"}
+	ITERATIONS=${ITERATIONS:-"0 1 31"}
+	PROCS=${PROCS:-"1 2 3 4 5 6 7 8"}
+	KERNELS=${KERNELS:-"simulate colsum lut2 lut4"}
+else
+	LINES=${LINES:-"1 3 33"}
+	ITERATIONS=${ITERATIONS:-"0 31"}
+	PROCS=${PROCS:-"1 3"}
+	KERNELS=${KERNELS:-"simulate lut4"}
+fi
+THREADS=${THREADS:-"2"}
+
+export CA_PRINT_HASH=1
+
+# result cache holding the configuration after the first iteration
+CACHE_DIR=$(mktemp -d)
+trap 'rm -rf "$CACHE_DIR"' EXIT
+
+# hash of a run, i.e. second field of the timing line
+hash_of() {
+	"$@" | head -n 1 | cut -f 2
+}
+
+# hash of the first member of an ensemble run (third field)
+ensemble_hash_of() {
+	"$@" | head -n 1 | cut -f 3
+}
+
+if [ "$1" == "--update" ]; then
+	rm -f $GOLDEN
+	for lines in $LINES; do
+		for its in $ITERATIONS; do
+			echo "$lines $its $(CA_KERNEL=simulate hash_of ./ca_seq $lines $its)" >> $GOLDEN
+		done
+	done
+	echo "updated $GOLDEN"
+	exit 0
+fi
+
+num_runs=0
+num_failed=0
+
+check() {
+	local expected=$1 name=$2
+	shift 2
+
+	local actual=$(${HASH_OF:-hash_of} "$@")
+	num_runs=$((num_runs + 1))
+	if [ "$actual" != "$expected" ]; then
+		num_failed=$((num_failed + 1))
+		echo "FAILED: $name: expected $expected, got '$actual'"
+	fi
+}
+
+for lines in $LINES; do
+	rm -f "$CACHE_DIR"/*
+	CA_CACHE_DIR=$CACHE_DIR CA_CACHE_CHECKPOINT=1 ./ca_seq $lines 1 > /dev/null
+
+	for its in $ITERATIONS; do
+		expected=$(awk -v l=$lines -v i=$its '$1 == l && $2 == i { print $3 }' $GOLDEN)
+		if [ -z "$expected" ]; then
+			echo "no golden hash for $lines lines, $its iterations (run with --update)"
+			exit 1
+		fi
+
+		for kernel in $KERNELS; do
+			export CA_KERNEL=$kernel
+			check $expected "ca_seq $lines $its ($kernel)" ./ca_seq $lines $its
+			check $expected "ca_ooc $lines $its ($kernel)" \
+				env CA_OOC_BAND=4 CA_OOC_STEPS=3 ./ca_ooc $lines $its
+
+			for np in $PROCS; do
+				for binary in ca_mpi_p2p ca_mpi_p2p_nb; do
+					check $expected "$binary $lines $its, $np procs ($kernel)" \
+						$MPIEXEC -n $np ./$binary $lines $its
+				done
+
+				check $expected "ca_mpi_p2p_nb $lines $its, $np procs, rebalancing ($kernel)" \
+					env CA_REBALANCE=1 $MPIEXEC -n $np ./ca_mpi_p2p_nb $lines $its
+
+				check $expected "ca_mpi_p2p_nb $lines $its, $np procs, progress chunks ($kernel)" \
+					env CA_PROGRESS_CHUNK=3 $MPIEXEC -n $np ./ca_mpi_p2p_nb $lines $its
+
+				check $expected "ca_mpi_p2p_nb $lines $its, $np procs, resumed from the cache ($kernel)" \
+					env CA_CACHE_DIR=$CACHE_DIR $MPIEXEC -n $np ./ca_mpi_p2p_nb $lines $its 2> /dev/null
+
+				for threads in $THREADS; do
+					check $expected "ca_mpi_p2p_nb_hybrid $lines $its, $np procs, $threads threads ($kernel)" \
+						env OMP_NUM_THREADS=$threads $MPIEXEC -n $np ./ca_mpi_p2p_nb_hybrid $lines $its
+
+					check $expected "ca_mpi_p2p_df $lines $its, $np procs, $threads threads ($kernel)" \
+						env OMP_NUM_THREADS=$threads CA_DF_BLOCK=4 $MPIEXEC -n $np ./ca_mpi_p2p_df $lines $its
+				done
+
+				# a single group of all processes, batched for a single process
+				HASH_OF=ensemble_hash_of check $expected "ca_mpi_ensemble $lines $its, $np procs ($kernel)" \
+					env CA_ENSEMBLE_GROUP=$np $MPIEXEC -n $np ./ca_mpi_ensemble $lines $its 424243,1
+			done
+		done
+
+		# observing only adds counting to the kernel, the reference one suffices
+		for np in $PROCS; do
+			check $expected "ca_mpi_p2p_nb $lines $its, $np procs, observables" \
+				env CA_KERNEL=simulate CA_STOP_STABLE=1 CA_OBSERVE_FILE=/dev/null \
+				$MPIEXEC -n $np ./ca_mpi_p2p_nb $lines $its 2> /dev/null
+		done
+	done
+	echo "$lines lines done"
+done
+
+echo "$num_runs runs, $num_failed failed"
+[ $num_failed -eq 0 ]
@@ -6,11 +6,17 @@ module purge
 module load openmpi
 
 JULIA_PATH=~/julia-1.5.3/bin
+
+# system image of julia/build_sysimage.jl, skips package loading and JIT warm-up
+JULIA_FLAGS=""
+if [ -f ./julia/ca_sysimage.so ]; then
+    JULIA_FLAGS="--sysimage ./julia/ca_sysimage.so"
+fi
 export JULIA_NUM_THREADS=$SLURM_CPUS_PER_TASK
 
  
 for iterations in 128 256 512; do
     for lines in 1000 10000 50000; do
-        srun -n $SLURM_NPROCS $JULIA_PATH/julia ./julia/julia_ca_mpi_benchmarking.jl $lines $iterations blocking
+        srun -n $SLURM_NPROCS $JULIA_PATH/julia $JULIA_FLAGS ./julia/julia_ca_mpi_benchmarking.jl $lines $iterations blocking
     done
 done
\ No newline at end of file
@@ -8,8 +8,11 @@ module load openmpi
 CPUS_PER_TASK=$1
 export OMP_NUM_THREADS=$CPUS_PER_TASK
 
+# memory usage per phase and rank (see Baseline/ca_mem.h) at normal speed
+export CA_MEMPROF=1
+
 for iterations in 128 256 512; do
     for lines in 1000 10000 50000; do
-            srun -n $SLURM_NPROCS --ntasks-per-node 1 --cpus-per-task $CPUS_PER_TASK valgrind --tool=massif --massif-out-file="${CPUS_PER_TASK}_massiv_${lines}_${iterations}.out.%p" ./Baseline/ca_mpi_p2p_nb_hybrid $lines $iterations
+            srun -n $SLURM_NPROCS --ntasks-per-node 1 --cpus-per-task $CPUS_PER_TASK ./Baseline/ca_mpi_p2p_nb_hybrid $lines $iterations
     done
 done
\ No newline at end of file
@@ -0,0 +1,20 @@
+# Builds julia/ca_sysimage.so with MPI.jl, MD5 and the methods compiled by
+# precompile_workload.jl, run from the repository root:
+#
+#     julia ./julia/build_sysimage.jl
+#
+# The experiment scripts pass the image to julia via --sysimage if it exists.
+using PackageCompiler
+
+sysimage_kwargs = (
+    sysimage_path = joinpath(@__DIR__, "ca_sysimage.so"),
+    precompile_execution_file = joinpath(@__DIR__, "precompile_workload.jl"),
+)
+
+# PackageCompiler versions with script support also keep the modules of
+# ca_modules.jl in the image, so the drivers do not load them at all
+if hasmethod(create_sysimage, Tuple{Vector{Symbol}}, (:script,))
+    sysimage_kwargs = merge(sysimage_kwargs, (script = joinpath(@__DIR__, "ca_modules.jl"),))
+end
+
+create_sysimage([:MPI, :MD5]; sysimage_kwargs...)
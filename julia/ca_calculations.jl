@@ -1,29 +1,33 @@
 module CaCalculations
 
-include("ca_common.jl")
-
-using .CaCommon
+using ..CaCommon
 using MPI
 using Base.Threads
 
-export get_calculate_handler, calculate_blocking!, calculate_non_blocking_parallel!, calculate_non_blocking_sequential!
+export get_calculate_handler, calculate_blocking!, calculate_non_blocking_parallel!, calculate_non_blocking_sequential!, calculate_non_blocking_tasks!
+export KernelSet, NativeKernel, kernel_implementations, select_kernels
 
-const anneal = [0, 0, 0, 0, 1, 0, 1, 1, 1, 1]
+const anneal = (0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x01, 0x01, 0x01)
 
 
 # calculate local ghost zones
-function boundary!(matrix::AbstractMatrix)
-    # buffer left and right
-    matrix[:,1] = matrix[:,end-1]
-    matrix[:,end] = matrix[:,2]
+function boundary!(matrix::AbstractMatrix{UInt8}, first_line::Int, last_line::Int)
+    # buffer left and right of every line
+    @inbounds for y in first_line:last_line
+        matrix[1, y] = matrix[end-1, y]
+        matrix[end, y] = matrix[2, y]
+    end
 end
 
+boundary!(matrix::AbstractMatrix{UInt8}) = boundary!(matrix, firstindex(matrix, 2), lastindex(matrix, 2))
+
 
 #=---------- computation step for each iteration ------------=#
-function transition(a::AbstractMatrix, x::Int, y::Int)
-    return anneal[a[y-1, x-1] + a[y, x-1] + a[y+1, x-1] +
-                  a[y-1, x  ] + a[y, x  ] + a[y+1, x  ] +
-                  a[y-1, x+1] + a[y, x+1] + a[y+1, x+1] + 1]
+# x: cell within a line, y: line (lines are stored as columns)
+@inline function transition(a::AbstractMatrix{UInt8}, x::Int, y::Int)
+    @inbounds return anneal[a[x-1, y-1] + a[x-1, y] + a[x-1, y+1] +
+                            a[x,   y-1] + a[x,   y] + a[x,   y+1] +
+                            a[x+1, y-1] + a[x+1, y] + a[x+1, y+1] + 1]
 end
 
 #=
@@ -34,13 +38,13 @@ this part can be deleted if not using ca_seriell.jl
 function boundary_seq!(matrix::AbstractMatrix)
 
     # buffer left and right
-    matrix[:,1] = matrix[:,end-1]
-    matrix[:,end] = matrix[:,2]
-
-    # buffer up and down
     matrix[1,:] = matrix[end-1,:]
     matrix[end,:] = matrix[2,:]
 
+    # buffer up and down
+    matrix[:,1] = matrix[:,end-1]
+    matrix[:,end] = matrix[:,2]
+
 end
 
 
@@ -50,7 +54,7 @@ function apply_transition_seq!(from_matrix::AbstractMatrix, to_matrix::AbstractM
     m, n = size(from_matrix)
     for j in 2:n-1
         for i in 2:m-1
-            to_matrix[i, j] = transition(from_matrix, j, i)
+            to_matrix[i, j] = transition(from_matrix, i, j)
         end
     end
 
@@ -63,7 +67,7 @@ function apply_transition_seq_parallel!(from_matrix::AbstractMatrix, to_matrix::
     m, n = size(from_matrix)
     @threads for j in 2:n-1
         for i in 2:m-1
-            to_matrix[i, j] = transition(from_matrix, j, i)
+            to_matrix[i, j] = transition(from_matrix, i, j)
         end
     end
 
@@ -71,11 +75,11 @@ end
 =#
 
 # compute multiple lines
-function apply_transition!(from_matrix::AbstractMatrix, to_matrix::AbstractMatrix, start_line::Int, end_line::Int)
+function apply_transition!(from_matrix::AbstractMatrix{UInt8}, to_matrix::AbstractMatrix{UInt8}, start_line::Int, end_line::Int)
 
-    for j in 2:(size(from_matrix, 2)-1)
-        for i in start_line:end_line
-            to_matrix[i, j] = transition(from_matrix, j, i)
+    for j in start_line:end_line
+        for i in 2:(size(from_matrix, 1)-1)
+            @inbounds to_matrix[i, j] = transition(from_matrix, i, j)
         end
     end
 
@@ -83,66 +87,110 @@ end
 
 
 # compute a single line
-function apply_transition!(from_matrix::AbstractMatrix, to_matrix::AbstractMatrix, start_line::Int)
+function apply_transition!(from_matrix::AbstractMatrix{UInt8}, to_matrix::AbstractMatrix{UInt8}, start_line::Int)
 
-    for j in 2:(size(from_matrix, 2)-1)
-        to_matrix[start_line, j] = transition(from_matrix, j, start_line)
-    end
+    apply_transition!(from_matrix, to_matrix, start_line, start_line)
 
 end
 
 
-# multithreaded version
-function apply_transition_parallel!(from_matrix::AbstractMatrix, to_matrix::AbstractMatrix, start_line::Int, end_line::Int)
+# multithreaded version, every thread computes whole lines
+function apply_transition_parallel!(from_matrix::AbstractMatrix{UInt8}, to_matrix::AbstractMatrix{UInt8}, start_line::Int, end_line::Int)
 
-    @threads for j in 2:(size(from_matrix, 2)-1)
-        for i in start_line:end_line
-            to_matrix[i, j] = transition(from_matrix, j, i)
+    @threads for j in start_line:end_line
+        for i in 2:(size(from_matrix, 1)-1)
+            @inbounds to_matrix[i, j] = transition(from_matrix, i, j)
         end
     end
 
 end
 
 
-function calculate_blocking!(cellularAutomaton, recv_buffer_lower_bound, recv_buffer_upper_bound, iterations)
+#=---------- native kernels from Baseline/libca_kernels.so ------------=#
+# Callable like apply_transition!. The lines of the transposed grid are
+# LINESIZE bytes apart as in the C implementation, Julia line y is line y - 1
+# of the C ABI. num_threads > 1 runs the kernel on as many OpenMP threads.
+struct NativeKernel
+    index::Cint
+    num_threads::Cint
+end
+
+function (kernel::NativeKernel)(from_matrix::Matrix{UInt8}, to_matrix::Matrix{UInt8}, start_line::Int, end_line::Int)
+    ccall((:ca_kernel_apply, CaCommon.kernel_lib), Cint,
+          (Cint, Ptr{UInt8}, Ptr{UInt8}, Csize_t, Cint, Cint, Cint, Cint),
+          kernel.index, from_matrix, to_matrix, size(from_matrix, 1), size(from_matrix, 1) - 2,
+          start_line - 1, end_line - start_line + 1, kernel.num_threads)
+    return nothing
+end
+
+(kernel::NativeKernel)(from_matrix::Matrix{UInt8}, to_matrix::Matrix{UInt8}, start_line::Int) = kernel(from_matrix, to_matrix, start_line, start_line)
+
+
+# kernel for single lines and the (possibly multithreaded) kernel for the inner lines
+struct KernelSet{S,P}
+    serial::S
+    parallel::P
+end
+
+const julia_kernels = KernelSet(apply_transition!, apply_transition_parallel!)
+
+const kernel_implementations = ("julia", "native")
+
+# "julia" selects apply_transition!, "native" the C kernel named by the
+# environment variable CA_KERNEL (as for the baseline, default simulate)
+function select_kernels(implementation::AbstractString)
+    if implementation == "julia"
+        return julia_kernels
+    elseif implementation == "native"
+        name = get(ENV, "CA_KERNEL", "simulate")
+        index = ccall((:ca_kernel_index, CaCommon.kernel_lib), Cint, (Cstring,), name)
+        if index < 0
+            names = [unsafe_string(ccall((:ca_kernel_name, CaCommon.kernel_lib), Cstring, (Cint,), i))
+                     for i in 0:(ccall((:ca_kernel_count, CaCommon.kernel_lib), Cint, ()) - 1)]
+            throw(ArgumentError("unknown native kernel '$name', available: $(join(names, " "))"))
+        end
+        return KernelSet(NativeKernel(index, 1), NativeKernel(index, nthreads()))
+    else
+        throw(ArgumentError("kernel implementation must be one of $(kernel_implementations)"))
+    end
+end
+
+function calculate_blocking!(cellularAutomaton::CellularAutomaton, iterations::Int, kernels::KernelSet=julia_kernels)
+    rank = cellularAutomaton.rank
+    num_procs = cellularAutomaton.num_procs
+    num_local_lines = cellularAutomaton.num_local_lines
+
     start_time = get_time()
     for iteration in 1:iterations
 
         boundary!(cellularAutomaton.from)
 
         # Compute boundaries
-        apply_transition!(cellularAutomaton.from, cellularAutomaton.to, 2)
-        apply_transition!(cellularAutomaton.from, cellularAutomaton.to, cellularAutomaton.num_local_lines + 1)
+        kernels.serial(cellularAutomaton.from, cellularAutomaton.to, 2)
+        kernels.serial(cellularAutomaton.from, cellularAutomaton.to, num_local_lines + 1)
 
-        # fill send buffer
-        global send_buffer_upper_bound = MPI.Buffer(cellularAutomaton.to[2,:])
-        global send_buffer_lower_bound = MPI.Buffer(cellularAutomaton.to[cellularAutomaton.num_local_lines + 1,:])
+        # exchange the new boundaries directly between the lines of the grids
+        ghost_upper, first_line, last_line, ghost_lower = cellularAutomaton.to_halo
 
         MPI.Sendrecv!(
-            send_buffer_upper_bound,
-            prev_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_SEND_UPPER_BOUND,
-            recv_buffer_lower_bound,
-            succ_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_RECV_LOWER_BOUND,
+            first_line,
+            prev_proc(rank, num_procs), CaCommon.TAG_SEND_UPPER_BOUND,
+            ghost_lower,
+            succ_proc(rank, num_procs), CaCommon.TAG_RECV_LOWER_BOUND,
             cellularAutomaton.comm
         )
 
         MPI.Sendrecv!(
-            send_buffer_lower_bound,
-            succ_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_SEND_LOWER_BOUND,
-            recv_buffer_upper_bound,
-            prev_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_RECV_UPPER_BOUND,
+            last_line,
+            succ_proc(rank, num_procs), CaCommon.TAG_SEND_LOWER_BOUND,
+            ghost_upper,
+            prev_proc(rank, num_procs), CaCommon.TAG_RECV_UPPER_BOUND,
             cellularAutomaton.comm
         )
-        
-        apply_transition!(cellularAutomaton.from, cellularAutomaton.to, 3, cellularAutomaton.num_local_lines)
-        
-        # Update ghost zones with received data
-        cellularAutomaton.to[1, :] .= recv_buffer_upper_bound.data
-        cellularAutomaton.to[cellularAutomaton.num_local_lines + 2, :] .= recv_buffer_lower_bound.data
 
-        temp = cellularAutomaton.from
-        cellularAutomaton.from = cellularAutomaton.to
-        cellularAutomaton.to = temp
+        kernels.serial(cellularAutomaton.from, cellularAutomaton.to, 3, num_local_lines)
+
+        swap!(cellularAutomaton)
 
     end
     stop_time = get_time()
@@ -150,57 +198,158 @@ function calculate_blocking!(cellularAutomaton, recv_buffer_lower_bound, recv_bu
 end
 
 
-function calculate_non_blocking!(cellularAutomaton, recv_buffer_lower_bound, recv_buffer_upper_bound, transition_handler, iterations)
+function calculate_non_blocking!(cellularAutomaton::CellularAutomaton, line_handler::L, transition_handler::F, iterations::Int) where {L,F}
+    rank = cellularAutomaton.rank
+    num_procs = cellularAutomaton.num_procs
+    num_local_lines = cellularAutomaton.num_local_lines
+    requests = Vector{MPI.Request}(undef, 4)
+
     start_time = get_time()
     for iteration in 1:iterations
-        requests = Vector{MPI.Request}()
-        
         boundary!(cellularAutomaton.from)
 
+        # ghost lines of the new grid are received in place, they are not written by the computation
+        ghost_upper, first_line, last_line, ghost_lower = cellularAutomaton.to_halo
+
         # Prepost matching receive operation
-        push!(requests, MPI.Irecv!(recv_buffer_upper_bound, prev_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_RECV_UPPER_BOUND, cellularAutomaton.comm))
-        push!(requests, MPI.Irecv!(recv_buffer_lower_bound, succ_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_RECV_LOWER_BOUND, cellularAutomaton.comm))
+        requests[1] = MPI.Irecv!(ghost_upper, prev_proc(rank, num_procs), CaCommon.TAG_RECV_UPPER_BOUND, cellularAutomaton.comm)
+        requests[2] = MPI.Irecv!(ghost_lower, succ_proc(rank, num_procs), CaCommon.TAG_RECV_LOWER_BOUND, cellularAutomaton.comm)
 
         # Compute boundaries
-        apply_transition!(cellularAutomaton.from, cellularAutomaton.to, 2)
-        apply_transition!(cellularAutomaton.from, cellularAutomaton.to, cellularAutomaton.num_local_lines + 1)
-
-        # fill send buffer
-        send_buffer_upper_bound = MPI.Buffer(cellularAutomaton.to[2,:])
-        send_buffer_lower_bound = MPI.Buffer(cellularAutomaton.to[cellularAutomaton.num_local_lines + 1,:])
+        line_handler(cellularAutomaton.from, cellularAutomaton.to, 2)
+        line_handler(cellularAutomaton.from, cellularAutomaton.to, num_local_lines + 1)
 
         # Isend operations
-        push!(requests, MPI.Isend(send_buffer_upper_bound, prev_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_SEND_UPPER_BOUND, cellularAutomaton.comm))
-        push!(requests, MPI.Isend(send_buffer_lower_bound, succ_proc(cellularAutomaton.rank, cellularAutomaton.num_procs), CaCommon.TAG_SEND_LOWER_BOUND, cellularAutomaton.comm))
-        
-        transition_handler(cellularAutomaton.from, cellularAutomaton.to, 3, cellularAutomaton.num_local_lines)
+        requests[3] = MPI.Isend(first_line, prev_proc(rank, num_procs), CaCommon.TAG_SEND_UPPER_BOUND, cellularAutomaton.comm)
+        requests[4] = MPI.Isend(last_line, succ_proc(rank, num_procs), CaCommon.TAG_SEND_LOWER_BOUND, cellularAutomaton.comm)
 
-        # setting pointers to new locations instead of updating values
-        temp = cellularAutomaton.from
-        cellularAutomaton.from = cellularAutomaton.to
-        cellularAutomaton.to = temp
+        transition_handler(cellularAutomaton.from, cellularAutomaton.to, 3, num_local_lines)
+
+        swap!(cellularAutomaton)
 
         # Wait for the completion of receive and send operations
         MPI.Waitall!(requests)
 
-        # Update ghost zones with received data
-        cellularAutomaton.from[1, :] .= recv_buffer_upper_bound.data
-        cellularAutomaton.from[cellularAutomaton.num_local_lines + 2, :] .= recv_buffer_lower_bound.data
-
     end
     stop_time = get_time()
     return start_time, stop_time
 end
 
 
-function calculate_non_blocking_parallel!(cellularAutomaton, recv_buffer_lower_bound, recv_buffer_upper_bound, iterations)
-    calculate_non_blocking!(cellularAutomaton, recv_buffer_lower_bound, recv_buffer_upper_bound, apply_transition_parallel!, iterations)
+function calculate_non_blocking_parallel!(cellularAutomaton::CellularAutomaton, iterations::Int, kernels::KernelSet=julia_kernels)
+    calculate_non_blocking!(cellularAutomaton, kernels.serial, kernels.parallel, iterations)
 end
 
 
-function calculate_non_blocking_sequential!(cellularAutomaton, recv_buffer_lower_bound, recv_buffer_upper_bound, iterations)
-    calculate_non_blocking!(cellularAutomaton, recv_buffer_lower_bound, recv_buffer_upper_bound, apply_transition!, iterations)
+function calculate_non_blocking_sequential!(cellularAutomaton::CellularAutomaton, iterations::Int, kernels::KernelSet=julia_kernels)
+    calculate_non_blocking!(cellularAutomaton, kernels.serial, kernels.serial, iterations)
 end
 
 
-end
\ No newline at end of file
+#=---------- persistent tasks, one per thread ------------=#
+# sense-reversing spin barrier for a fixed number of tasks, waiting tasks sit
+# at GC safepoints so a collection triggered by another task can proceed
+struct SpinBarrier
+    num_tasks::Int
+    count::Atomic{Int}
+    sense::Atomic{Bool}
+end
+
+SpinBarrier(num_tasks::Int) = SpinBarrier(num_tasks, Atomic{Int}(0), Atomic{Bool}(false))
+
+# local_sense is owned by the calling task, returns its new value
+function barrier_wait!(barrier::SpinBarrier, local_sense::Bool)
+    local_sense = !local_sense
+    if atomic_add!(barrier.count, 1) == barrier.num_tasks - 1
+        barrier.count[] = 0
+        barrier.sense[] = local_sense
+    else
+        while barrier.sense[] != local_sense
+            GC.safepoint()
+        end
+    end
+    return local_sense
+end
+
+
+# contiguous block of the inner lines 3:num_local_lines owned by task t
+function line_block(num_local_lines::Int, t::Int, num_tasks::Int)
+    num_inner_lines = max(num_local_lines - 2, 0)
+    return (3 + div(num_inner_lines * (t - 1), num_tasks)):(2 + div(num_inner_lines * t, num_tasks))
+end
+
+
+# lines task 1 computes between two progress calls of the halo exchange
+const TASK_CHUNK_LINES = 32
+
+# Iteration loop of task t. Every task swaps its own references to the grids,
+# task 1 additionally owns the ghost and boundary lines and drives MPI.
+function task_iterations!(cellularAutomaton::CellularAutomaton, line_handler::L, barrier::SpinBarrier,
+                          requests::Vector{MPI.Request}, t::Int, num_tasks::Int, iterations::Int) where {L}
+    rank = cellularAutomaton.rank
+    num_procs = cellularAutomaton.num_procs
+    num_local_lines = cellularAutomaton.num_local_lines
+    from, to = cellularAutomaton.from, cellularAutomaton.to
+    from_halo, to_halo = cellularAutomaton.from_halo, cellularAutomaton.to_halo
+    block = line_block(num_local_lines, t, num_tasks)
+    sense = false
+
+    for iteration in 1:iterations
+        boundary!(from, first(block), last(block))
+        if t == 1
+            boundary!(from, 1, 2)
+            boundary!(from, num_local_lines + 1, num_local_lines + 2)
+        end
+        sense = barrier_wait!(barrier, sense)
+
+        if t == 1
+            ghost_upper, first_line, last_line, ghost_lower = to_halo
+
+            requests[1] = MPI.Irecv!(ghost_upper, prev_proc(rank, num_procs), CaCommon.TAG_RECV_UPPER_BOUND, cellularAutomaton.comm)
+            requests[2] = MPI.Irecv!(ghost_lower, succ_proc(rank, num_procs), CaCommon.TAG_RECV_LOWER_BOUND, cellularAutomaton.comm)
+
+            line_handler(from, to, 2)
+            line_handler(from, to, num_local_lines + 1)
+
+            requests[3] = MPI.Isend(first_line, prev_proc(rank, num_procs), CaCommon.TAG_SEND_UPPER_BOUND, cellularAutomaton.comm)
+            requests[4] = MPI.Isend(last_line, succ_proc(rank, num_procs), CaCommon.TAG_SEND_LOWER_BOUND, cellularAutomaton.comm)
+
+            # progress the exchange between chunks of the own block
+            for chunk_start in first(block):TASK_CHUNK_LINES:last(block)
+                line_handler(from, to, chunk_start, min(chunk_start + TASK_CHUNK_LINES - 1, last(block)))
+                MPI.Testall!(requests)
+            end
+
+            MPI.Waitall!(requests)
+        else
+            line_handler(from, to, first(block), last(block))
+        end
+        sense = barrier_wait!(barrier, sense)
+
+        from, to = to, from
+        from_halo, to_halo = to_halo, from_halo
+    end
+end
+
+
+function calculate_non_blocking_tasks!(cellularAutomaton::CellularAutomaton, iterations::Int, kernels::KernelSet=julia_kernels)
+    num_tasks = nthreads()
+    barrier = SpinBarrier(num_tasks)
+    requests = Vector{MPI.Request}(undef, 4)
+
+    start_time = get_time()
+    # one long-lived task per thread, task 1 runs on the main thread which initialized MPI
+    @threads :static for t in 1:num_tasks
+        task_iterations!(cellularAutomaton, kernels.serial, barrier, requests, t, num_tasks, iterations)
+    end
+
+    # the tasks only swapped their local references
+    if isodd(iterations)
+        swap!(cellularAutomaton)
+    end
+    stop_time = get_time()
+    return start_time, stop_time
+end
+
+
+end
@@ -1,8 +1,13 @@
 module CaCommon
 
-export CellularAutomaton, timespec, get_time, measure_time_diff, prev_proc, succ_proc
+using MPI
 
-const utility_lib = "./julia/libutility.so" 
+export CellularAutomaton, swap!, line_view, timespec, get_time, measure_time_diff, prev_proc, succ_proc
+
+const utility_lib = "./julia/libutility.so"
+
+# C kernels of the baseline, built with `make -C Baseline libca_kernels.so`
+const kernel_lib = "./Baseline/libca_kernels.so"
 
 const XSIZE = 1024
 const LINESIZE = XSIZE + 2
@@ -22,13 +27,45 @@ struct timespec
 end
 
 
-mutable struct CellularAutomaton
-    from
-    to
-    num_local_lines
-    rank
-    num_procs
-    comm
+# contiguous view of a line, lines are stored as columns (LINESIZE x lines)
+line_view(matrix::AbstractMatrix, y::Int) = view(matrix, :, y)
+
+
+# MPI buffers for the ghost lines and the first/last line of a grid:
+# (upper ghost line, first line, last line, lower ghost line)
+function halo_buffers(matrix::AbstractMatrix, num_local_lines::Int)
+    return (MPI.Buffer(line_view(matrix, 1)),
+            MPI.Buffer(line_view(matrix, 2)),
+            MPI.Buffer(line_view(matrix, num_local_lines + 1)),
+            MPI.Buffer(line_view(matrix, num_local_lines + 2)))
+end
+
+
+# grid is stored transposed (one line per column) so halo lines are
+# contiguous and can be passed to MPI without copying
+mutable struct CellularAutomaton{M<:AbstractMatrix{UInt8}, B}
+    from::M
+    to::M
+    from_halo::NTuple{4, B}
+    to_halo::NTuple{4, B}
+    num_local_lines::Int
+    rank::Int
+    num_procs::Int
+    comm::MPI.Comm
+end
+
+
+function CellularAutomaton(from::M, to::M, num_local_lines::Int, rank::Int, num_procs::Int, comm::MPI.Comm) where {M<:AbstractMatrix{UInt8}}
+    return CellularAutomaton(from, to, halo_buffers(from, num_local_lines), halo_buffers(to, num_local_lines),
+                             num_local_lines, rank, num_procs, comm)
+end
+
+
+# setting pointers to new locations instead of updating values
+function swap!(cellularAutomaton::CellularAutomaton)
+    cellularAutomaton.from, cellularAutomaton.to = cellularAutomaton.to, cellularAutomaton.from
+    cellularAutomaton.from_halo, cellularAutomaton.to_halo = cellularAutomaton.to_halo, cellularAutomaton.from_halo
+    return cellularAutomaton
 end
 
 
@@ -52,4 +89,4 @@ function succ_proc(n::Int, num_procs::Int)
 end
 
 
-end
\ No newline at end of file
+end
@@ -1,8 +1,6 @@
 module CaInit
 
-include("ca_common.jl")
-
-using .CaCommon
+using ..CaCommon
 using MPI
 
 export nextRandomLEcuyer, randInt, ca_init_config!, ca_mpi_init, initialize_ca
@@ -18,22 +16,20 @@ function randInt(n)
 end
 
 
-function ca_init_config!(buf::AbstractMatrix, lines::Int, skip_lines::Int)
+# buf has dimension (LINESIZE, lines+2), i.e. one line per column
+function ca_init_config!(buf::AbstractMatrix{UInt8}, lines::Int, skip_lines::Int)
     ccall(("initRandomLEcuyer", CaCommon.utility_lib), Cvoid, (Cint,), 424243)
 
-    scratch = 0
-
     #= let the RNG spin for some rounds (used for distributed initialization) =#
-    # matrix has dimension (lines+2,XSIZE)
-	for y in 2:(skip_lines+1)
-		for x in 2:(CaCommon.XSIZE+1)
-			scratch = scratch + randInt(100) >= 50;
+    for y in 2:(skip_lines+1)
+        for x in 2:(CaCommon.XSIZE+1)
+            nextRandomLEcuyer()
         end
     end
 
     # Initialize the matrix with random values
-    for x in 2:(lines+1)
-        for y in 2:(CaCommon.XSIZE+1)
+    for y in 2:(lines+1)
+        for x in 2:(CaCommon.XSIZE+1)
             buf[x, y] = randInt(Cint(100)) >= 50
         end
     end
@@ -68,44 +64,35 @@ function initialize_ca(num_total_lines::Int, iterations::Int)
 
     num_local_lines, num_skip_lines = ca_mpi_init(num_procs, rank, num_total_lines)
 
-    global from = zeros(UInt8,num_local_lines + 2, CaCommon.LINESIZE)
-    global to = zeros(UInt8,num_local_lines + 2, CaCommon.LINESIZE)
+    # lines are stored as columns, so every line is contiguous in memory
+    from = zeros(UInt8, CaCommon.LINESIZE, num_local_lines + 2)
+    to = zeros(UInt8, CaCommon.LINESIZE, num_local_lines + 2)
 
-    # Initialize from matrix 
+    # Initialize from matrix
     ca_init_config!(from, num_local_lines, num_skip_lines)
 
-    # fill send buffer
-    send_buffer_upper_bound = MPI.Buffer(from[2,:])
-    send_buffer_lower_bound = MPI.Buffer(from[num_local_lines + 1,:])
-
-    # Initialize receive buffers
-    recv_buffer_upper_bound = MPI.Buffer(zeros(UInt8, CaCommon.LINESIZE))
-    recv_buffer_lower_bound = MPI.Buffer(zeros(UInt8, CaCommon.LINESIZE))
+    cellularAutomaton = CellularAutomaton(from, to, num_local_lines, rank, num_procs, comm)
+    ghost_upper, first_line, last_line, ghost_lower = cellularAutomaton.from_halo
 
-    # initial data exchange
+    # initial data exchange, received directly into the ghost lines
     MPI.Sendrecv!(
-        send_buffer_upper_bound,
+        first_line,
         prev_proc(rank, num_procs), CaCommon.TAG_SEND_UPPER_BOUND,
-        recv_buffer_lower_bound,
+        ghost_lower,
         succ_proc(rank, num_procs), CaCommon.TAG_RECV_LOWER_BOUND,
         comm
     )
 
     MPI.Sendrecv!(
-        send_buffer_lower_bound,
+        last_line,
         succ_proc(rank, num_procs), CaCommon.TAG_SEND_LOWER_BOUND,
-        recv_buffer_upper_bound,
+        ghost_upper,
         prev_proc(rank, num_procs), CaCommon.TAG_RECV_UPPER_BOUND,
         comm
     )
 
-    # Update ghost zones with received data
-    from[1, :] .= recv_buffer_upper_bound.data
-    from[num_local_lines + 2, :] .= recv_buffer_lower_bound.data
-
-    cellularAutomaton = CellularAutomaton(from, to, num_local_lines, rank, num_procs, comm)
-    return cellularAutomaton, recv_buffer_lower_bound, recv_buffer_upper_bound
+    return cellularAutomaton
 end
 
 
-end
\ No newline at end of file
+end
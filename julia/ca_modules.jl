@@ -0,0 +1,8 @@
+# Loads the modules of the cellular automaton into Main. A system image built
+# by build_sysimage.jl already contains them, they are only included otherwise.
+if !isdefined(Main, :CaReport)
+    include("ca_common.jl")
+    include("ca_init.jl")
+    include("ca_calculations.jl")
+    include("ca_report.jl")
+end
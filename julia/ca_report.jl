@@ -1,83 +1,69 @@
 module CaReport
 
-include("ca_common.jl")
-
-using .CaCommon
+using ..CaCommon
 using MPI
 using MD5
 
-export send_local_matrix, construct_full_matrix, calculate_md5_hash, hash_and_report
+export send_local_matrix, gather_md5_hash!, hash_and_report
 
 
 function send_local_matrix(from, num_local_lines, comm)
-    #send local buffer without upper and lower ghost zone
-    send_buffer_local_matrix = MPI.Buffer(from[2:num_local_lines+1,:])
+    #send local buffer without upper and lower ghost zone (contiguous, lines are columns)
+    send_buffer_local_matrix = MPI.Buffer(view(from, :, 2:num_local_lines+1))
     MPI.Send(send_buffer_local_matrix, 0, CaCommon.TAG_RESULT, comm)
 
 end
 
 
-function construct_full_matrix(cellularAutomaton, num_total_lines)
-    if cellularAutomaton.rank == 0
-        global full_matrix = cellularAutomaton.from[2:end-1,:]
-        
-        num_remainder_procs = num_total_lines % cellularAutomaton.num_procs
-
-        # collecting all local buffers and concatenating with already received data
-        for i in 1:(cellularAutomaton.num_procs-1)
-            num_lines = div(num_total_lines, cellularAutomaton.num_procs)
-            if i < num_remainder_procs
-                num_lines += 1
-            end
-
-            
-            recv_buf = MPI.Buffer(zeros(UInt8, num_lines, CaCommon.LINESIZE))
-            status = MPI.Recv!(recv_buf, i, CaCommon.TAG_RESULT, cellularAutomaton.comm)
-            
-            # Concatenate new data to already received matrix
-            full_matrix = vcat(full_matrix, recv_buf.data)
-            
-        end
-        return full_matrix
-        
-    else
-        send_local_matrix(cellularAutomaton.from, cellularAutomaton.num_local_lines, cellularAutomaton.comm)
-    end
+# simulate the clean ghost zones function of baseline and feed the lines
+# (stored as contiguous columns) into the MD5 context
+function update_md5!(ctx, lines::AbstractMatrix{UInt8})
+    lines[1, :] .= 0
+    lines[end, :] .= 0
+
+    MD5.update!(ctx, vec(lines))
 end
 
 
-function calculate_md5_hash(matrix::AbstractMatrix)
+#=------- stream all local grids through an incremental MD5 on rank 0 ---------=#
+# Rank 0 receives one slab after the other into a single buffer sized for the
+# largest slab, so the full grid is never assembled. Returns the hash string
+# on rank 0 and nothing on all other ranks.
+function gather_md5_hash!(cellularAutomaton::CellularAutomaton, num_total_lines::Int)
+    if cellularAutomaton.rank != 0
+        send_local_matrix(cellularAutomaton.from, cellularAutomaton.num_local_lines, cellularAutomaton.comm)
+        return nothing
+    end
 
-    # simulate the clean ghost zones function of baseline
-    matrix[:,1] = zeros(UInt8, size(matrix,1))
-    matrix[:,end] = zeros(UInt8, size(matrix,1))
+    ctx = MD5.MD5_CTX()
+    update_md5!(ctx, view(cellularAutomaton.from, :, 2:cellularAutomaton.num_local_lines+1))
 
-    # transpose matrix because of column major order in julia
-    transposed_matrix = transpose(matrix)
+    # same partitioning as ca_mpi_init, the first ranks hold the additional lines
+    num_remainder_procs = num_total_lines % cellularAutomaton.num_procs
+    max_lines = div(num_total_lines, cellularAutomaton.num_procs) + (num_remainder_procs > 0 ? 1 : 0)
+    recv_matrix = zeros(UInt8, CaCommon.LINESIZE, max_lines)
 
-    # Flatten the matrix into a one-dimensional array
-    flattened_matrix = vec(transposed_matrix)
+    for i in 1:(cellularAutomaton.num_procs-1)
+        num_lines = div(num_total_lines, cellularAutomaton.num_procs)
+        if i < num_remainder_procs
+            num_lines += 1
+        end
 
-    # Convert the flattened array to a byte array
-    byte_array = reinterpret(UInt8, flattened_matrix)
-    
-    # Calculate the MD5 hash
-    hash_object = md5(byte_array)
-    
-    hash_string = join([string(i, base=16, pad=2) for i in hash_object])
+        slab = view(recv_matrix, :, 1:num_lines)
+        MPI.Recv!(MPI.Buffer(slab), i, CaCommon.TAG_RESULT, cellularAutomaton.comm)
+        update_md5!(ctx, slab)
+    end
 
-    return hash_string
+    return bytes2hex(MD5.digest!(ctx))
 end
 
 
-function convert_timespec(start_time::Main.CaCalculations.CaCommon.timespec, stop_time::Main.CaCalculations.CaCommon.timespec)
-end
-
-function hash_and_report(start_time::Main.CaCalculations.CaCommon.timespec, stop_time::Main.CaCalculations.CaCommon.timespec, full_matrix)
-    hash_value = calculate_md5_hash(full_matrix)
-    computation_time = measure_time_diff(timespec(start_time.sec, start_time.nsec),timespec(stop_time.sec,stop_time.nsec))  
+# collective, returns computation time and hash (nothing on ranks other than 0)
+function hash_and_report(start_time::timespec, stop_time::timespec, cellularAutomaton::CellularAutomaton, num_total_lines::Int)
+    hash_value = gather_md5_hash!(cellularAutomaton, num_total_lines)
+    computation_time = measure_time_diff(start_time, stop_time)
     return computation_time, hash_value
-end 
+end
 
 
 end
@@ -1,6 +1,4 @@
-include("ca_init.jl")
-include("ca_calculations.jl")
-include("ca_report.jl")
+include("ca_modules.jl")
 
 using .CaInit
 using .CaCalculations
@@ -10,18 +8,21 @@ using MPI
 @enum ExecutionMode begin
     nb_parallel
     nb_sequential
+    nb_tasks
     blocking
 end
 
 # check if Arguments are set correct
-if length(ARGS) != 3
-    println("Need 3 Arguments: number of lines, number of iterations, one of the following options: [", string(nb_parallel),", ", string(nb_sequential),", ", string(blocking),"]")
+if !(3 <= length(ARGS) <= 4)
+    println("Need 3 Arguments: number of lines, number of iterations, one of the following options: [", string(nb_parallel),", ", string(nb_sequential),", ", string(nb_tasks),", ", string(blocking),"]")
+    println("Optional 4th Argument: kernel implementation ", kernel_implementations, " (native uses CA_KERNEL of Baseline/libca_kernels.so)")
     exit(1)
 end
 
 num_total_lines = parse(Int, ARGS[1])
 iterations = parse(Int, ARGS[2])
 execution_mode = ARGS[3]
+kernel_implementation = length(ARGS) == 4 ? ARGS[4] : "julia"
 
 
 function get_calculate_handler(execution_mode)
@@ -29,16 +30,19 @@ function get_calculate_handler(execution_mode)
         return calculate_non_blocking_parallel!
     elseif execution_mode == string(nb_sequential)
         return calculate_non_blocking_sequential!
+    elseif execution_mode == string(nb_tasks)
+        return calculate_non_blocking_tasks!
     elseif execution_mode == string(blocking)
         return calculate_blocking!
     else
-        println("Argument 3 must be one of the following options: [", string(nb_parallel),", ", string(nb_sequential),", ", string(blocking),"]")
+        println("Argument 3 must be one of the following options: [", string(nb_parallel),", ", string(nb_sequential),", ", string(nb_tasks),", ", string(blocking),"]")
         exit(1)
     end
 end
 
 
 calculate_handler! = get_calculate_handler(execution_mode)
+kernels = select_kernels(kernel_implementation)
 
 
 num_runs = 5
@@ -46,12 +50,11 @@ computation_times = []
 
 MPI.Init()
 for i in 1:(num_runs+1)
-    cellularAutomata, recv_buffer_lower_bound, recv_buffer_upper_bound = initialize_ca(num_total_lines, iterations)
-    start_time, stop_time = calculate_handler!(cellularAutomata, recv_buffer_lower_bound, recv_buffer_upper_bound, iterations)
+    cellularAutomata = initialize_ca(num_total_lines, iterations)
+    start_time, stop_time = calculate_handler!(cellularAutomata, iterations, kernels)
     MPI.Barrier(cellularAutomata.comm)
-    full_matrix = construct_full_matrix(cellularAutomata, num_total_lines)
+    computation_time, hash_value = hash_and_report(start_time, stop_time, cellularAutomata, num_total_lines)
     if cellularAutomata.rank == 0
-        computation_time, hash_value = hash_and_report(start_time, stop_time, full_matrix)
         append!(computation_times,computation_time)
         if i == num_runs+1
             println("Lines: ", num_total_lines, ", Iterations: ", iterations)
@@ -13,8 +13,15 @@ module purge
 module load openmpi
 
 JULIA_PATH=~/julia-1.5.3/bin
+
+# system image of julia/build_sysimage.jl, skips package loading and JIT warm-up
+JULIA_FLAGS=""
+if [ -f ./julia/ca_sysimage.so ]; then
+    JULIA_FLAGS="--sysimage ./julia/ca_sysimage.so"
+fi
+
 export JULIA_NUM_THREADS=$SLURM_CPUS_PER_TASK
 
-srun -n $SLURM_NPROCS $JULIA_PATH/julia ./julia/julia_ca_mpi_benchmark_memory.jl 100 10 nb_parallel
-#srun -n $SLURM_NPROCS $JULIA_PATH/julia ./ca_mpi_nb_hybrid.jl 50000 512 nb_sequential
-#srun -n $SLURM_NPROCS $JULIA_PATH/julia ./julia_ca_mpi.jl 50000 512 blocking
+srun -n $SLURM_NPROCS $JULIA_PATH/julia $JULIA_FLAGS ./julia/julia_ca_mpi_benchmark_memory.jl 100 10 nb_parallel
+#srun -n $SLURM_NPROCS $JULIA_PATH/julia $JULIA_FLAGS ./ca_mpi_nb_hybrid.jl 50000 512 nb_sequential
+#srun -n $SLURM_NPROCS $JULIA_PATH/julia $JULIA_FLAGS ./julia_ca_mpi.jl 50000 512 blocking
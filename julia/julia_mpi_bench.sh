@@ -13,6 +13,13 @@ module purge
 module load openmpi
 
 JULIA_PATH=~/julia-1.5.3/bin
+
+# system image of julia/build_sysimage.jl, skips package loading and JIT warm-up
+JULIA_FLAGS=""
+if [ -f ./julia/ca_sysimage.so ]; then
+    JULIA_FLAGS="--sysimage ./julia/ca_sysimage.so"
+fi
+
 export JULIA_NUM_THREADS=$SLURM_CPUS_PER_TASK
 
-srun -n $SLURM_NPROCS $JULIA_PATH/julia ./julia/julia_ca_mpi_benchmark_memory.jl 50000 512 nb_parallel
\ No newline at end of file
+srun -n $SLURM_NPROCS $JULIA_PATH/julia $JULIA_FLAGS ./julia/julia_ca_mpi_benchmark_memory.jl 50000 512 nb_parallel
\ No newline at end of file
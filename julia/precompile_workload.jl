@@ -0,0 +1,26 @@
+# Short single-rank run of every execution mode and kernel implementation.
+# build_sysimage.jl records the methods compiled here into the system image.
+include("ca_modules.jl")
+
+using .CaInit
+using .CaCalculations
+using .CaReport
+
+using MPI
+
+const workload_lines = 64
+const workload_iterations = 4
+
+kernel_sets = isfile(CaCommon.kernel_lib) ? (select_kernels("julia"), select_kernels("native")) : (select_kernels("julia"),)
+
+MPI.Init()
+for kernels in kernel_sets
+    for calculate_handler! in (calculate_blocking!, calculate_non_blocking_sequential!,
+                               calculate_non_blocking_parallel!, calculate_non_blocking_tasks!)
+        cellularAutomaton = initialize_ca(workload_lines, workload_iterations)
+        start_time, stop_time = calculate_handler!(cellularAutomaton, workload_iterations, kernels)
+        MPI.Barrier(cellularAutomaton.comm)
+        hash_and_report(start_time, stop_time, cellularAutomaton, workload_lines)
+    end
+end
+MPI.Finalize()